@@ -0,0 +1,106 @@
+/*
+  Copyright (C) 2017 Hoyoung Lee
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <cstdint>
+#include <algorithm>
+
+#include "sobel.SIMD.hpp"
+
+/*
+  SIMD non-maximum suppression for canny3x3Frame() of canny.hpp. Like
+  sobel.SIMD.hpp, only the line kernels are compiled, into SOBEL_NAMESPACE,
+  when that is defined.
+*/
+
+#ifdef SOBEL_NAMESPACE
+namespace SOBEL_NAMESPACE {
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+/*
+  Magnitudes are compared in the 32-bit lanes the orientation codes are
+  widened to. The magnitude lines come from a canny_ring, which is padded
+  to whole vectors, so only the edge line ends with a partial store.
+*/
+static inline sobel_widen8x32::vec canny_load(const uint16_t *p, int n) { return sobel_widen16::load(p, n); }
+static inline sobel_widen8x32::vec canny_load(const uint32_t *p, int)
+{
+  sobel_widen8x32::vec v;
+  return v.load(p);
+}
+
+template <typename M>
+inline void cannyNmsLine(const M *prevMag, const M *currMag, const M *nextMag,
+			 const uint8_t *dirLine, uint8_t *edgeLine, size_t width, M low, M high)
+{
+  typedef sobel_widen8x32::vec V;
+  enum { lanes = sobel_widen8x32::lanes };
+
+  for (size_t x = 0; x < width; x += lanes) {
+    int n = (int)std::min(width - x, (size_t)lanes);
+    V mVec = canny_load(&currMag[x], lanes);
+    V wwVec = canny_load(&currMag[(int)x-1], lanes), eeVec = canny_load(&currMag[x+1], lanes);
+    V nwVec = canny_load(&prevMag[(int)x-1], lanes), nnVec = canny_load(&prevMag[x], lanes);
+    V neVec = canny_load(&prevMag[x+1], lanes);
+    V swVec = canny_load(&nextMag[(int)x-1], lanes), ssVec = canny_load(&nextMag[x], lanes);
+    V seVec = canny_load(&nextMag[x+1], lanes);
+    V dirVec = sobel_widen8x32::load(&dirLine[x], lanes) & V(3);
+
+    // neighbours before (a) and after (b) the pixel along the gradient
+    V aVec = select(dirVec == V(0), wwVec, select(dirVec == V(1), nwVec, select(dirVec == V(2), nnVec, neVec)));
+    V bVec = select(dirVec == V(0), eeVec, select(dirVec == V(1), seVec, select(dirVec == V(2), ssVec, swVec)));
+    V edgeVec = select((mVec > aVec) & (mVec >= bVec) & (mVec >= V((int32_t)low)),
+		       select(mVec >= V((int32_t)high), V(CANNY_STRONG), V(CANNY_WEAK)), V(CANNY_NONE));
+
+    store_narrow(edgeVec, &edgeLine[x], n);
+  }
+}
+
+inline void cannyNmsLine16(const uint16_t *prevMag, const uint16_t *currMag, const uint16_t *nextMag,
+			   const uint8_t *dirLine, uint8_t *edgeLine, size_t width, uint16_t low, uint16_t high)
+{
+  cannyNmsLine(prevMag, currMag, nextMag, dirLine, edgeLine, width, low, high);
+}
+
+inline void cannyNmsLine32(const uint32_t *prevMag, const uint32_t *currMag, const uint32_t *nextMag,
+			   const uint8_t *dirLine, uint8_t *edgeLine, size_t width, uint32_t low, uint32_t high)
+{
+  cannyNmsLine(prevMag, currMag, nextMag, dirLine, edgeLine, width, low, high);
+}
+#endif
+
+#ifdef SOBEL_NAMESPACE
+}
+#endif
+
+#if !defined(SOBEL_NAMESPACE) && (defined(__x86_64__) || defined(__i386__))
+
+template <typename B = border_zero>
+inline void edgeCannyKernel(cpixmap<uint8_t>& gray, cpixmap<uint8_t>& edges,
+			    uint16_t low, uint16_t high, int norm = SOBEL_L2_NORM, const B& border = B())
+{
+  canny3x3Frame<B>(gray, edges, low, high, norm, edgeSobelMagnitudeLine, cannyNmsLine16, border);
+}
+
+template <typename B = border_zero>
+inline void edgeCannyKernel(cpixmap<uint16_t>& gray, cpixmap<uint8_t>& edges,
+			    uint32_t low, uint32_t high, int norm = SOBEL_L2_NORM, const B& border = B())
+{
+  canny3x3Frame<B>(gray, edges, low, high, norm, edgeSobelMagnitudeLine, cannyNmsLine32, border);
+}
+#endif
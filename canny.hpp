@@ -0,0 +1,252 @@
+/*
+  Copyright (C) 2017 Hoyoung Lee
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <cassert>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+
+#include <cpixmap.hpp>
+#include <cchunk.hpp>
+#include <sobel.hpp>
+
+/*
+  Streaming Canny edge detector on top of the fused Sobel magnitude and
+  orientation kernels.
+
+  Each strip of a band is walked once from top to bottom. Sobel fills one
+  line of a 3-line magnitude ring per input line, and as soon as a line
+  has both of its neighbours the non-maximum suppression and the double
+  thresholding turn it into CANNY_WEAK/CANNY_STRONG codes of the edge map.
+  Only the hysteresis, which needs the connectivity of the whole band,
+  runs over the edge map afterwards; everything before it keeps O(width)
+  memory per thread.
+
+  low and high are thresholds on the Sobel magnitude of sobel.hpp, i.e.
+  with the exact 1 2 1 taps (4 times the normalized gradient).
+*/
+
+/*
+  Three lines of width elements with one zero element at both ends,
+  rotated one line up by shiftLines(). The lines are padded up to 64
+  elements so that SIMD kernels can load and store whole vectors.
+*/
+template <typename T>
+class canny_ring {
+public:
+  canny_ring(size_t width);
+  virtual ~canny_ring(void);
+  void shiftLines(void);
+  void clearNextLine(void) { std::memset(m_line_buffer[2], 0, m_stride); }
+  T* getPrevLine(void) { return m_line_buffer[0] + 1; }
+  T* getCurrLine(void) { return m_line_buffer[1] + 1; }
+  T* getNextLine(void) { return m_line_buffer[2] + 1; }
+private:
+  size_t m_stride;
+  uint8_t *m_buffer;
+  T *m_line_buffer[3];
+};
+
+template <typename T>
+canny_ring<T>::canny_ring(size_t width)
+  : m_stride((((width + 63) & ~(size_t)63) + 2) * sizeof(T)),
+    m_buffer(NULL)
+{
+  m_buffer = (uint8_t *)cpool::getGlobal().allocate(3 * m_stride, CPIXMAP_ALIGNMENT);
+  std::memset(m_buffer, 0, 3 * m_stride);
+  for (size_t i = 0; i < 3; ++i)
+    m_line_buffer[i] = (T *)(m_buffer + i*m_stride);
+}
+
+template <typename T>
+canny_ring<T>::~canny_ring(void)
+{
+  cpool::getGlobal().release(m_buffer);
+}
+
+template <typename T>
+void canny_ring<T>::shiftLines(void)
+{
+  T *temp = m_line_buffer[0];
+  m_line_buffer[0] = m_line_buffer[1];
+  m_line_buffer[1] = m_line_buffer[2];
+  m_line_buffer[2] = temp;
+}
+
+/*
+  The flood-fill stack of cannyHysteresis(), pixel offsets in a pool
+  buffer that doubles when full, so that a steady frame size reuses the
+  same buffers instead of reaching the heap.
+*/
+class canny_stack {
+public:
+  canny_stack(void) : m_size(0), m_capacity(0), m_buffer(NULL) {}
+  virtual ~canny_stack(void) { cpool::getGlobal().release(m_buffer); }
+  bool empty(void) const { return m_size == 0; }
+  void push(size_t i) { if (m_size == m_capacity) grow(); m_buffer[m_size++] = i; }
+  size_t pop(void) { return m_buffer[--m_size]; }
+private:
+  void grow(void);
+  size_t m_size, m_capacity;
+  size_t *m_buffer;
+};
+
+inline void canny_stack::grow(void)
+{
+  size_t capacity = m_capacity ? 2*m_capacity : 4096;
+  size_t *buffer = (size_t *)cpool::getGlobal().allocate(capacity * sizeof(size_t), CPIXMAP_ALIGNMENT);
+  if (m_size) std::memcpy(buffer, m_buffer, m_size * sizeof(size_t));
+  cpool::getGlobal().release(m_buffer);
+  m_buffer = buffer;
+  m_capacity = capacity;
+}
+
+/*
+  Promotes the CANNY_WEAK pixels 8-connected to a CANNY_STRONG one to
+  CANNY_EDGE, and clears everything else.
+*/
+inline void cannyHysteresis(cpixmap<uint8_t>& edges, size_t z = 0)
+{
+  const size_t width = edges.getWidth(), height = edges.getHeight();
+  canny_stack stack;
+
+  for (size_t y = 0; y < height; ++y) {
+    uint8_t *edgeLine = edges.getLine(y, z);
+    for (size_t x = 0; x < width; ++x) {
+      if (edgeLine[x] != CANNY_STRONG) continue;
+      edgeLine[x] = CANNY_EDGE;
+      stack.push(y*width + x);
+      while (!stack.empty()) {
+	size_t i = stack.pop(), cx = i % width, cy = i / width;
+	for (size_t ny = (cy > 0 ? cy-1 : 0); ny <= cy+1 && ny < height; ++ny) {
+	  uint8_t *line = edges.getLine(ny, z);
+	  for (size_t nx = (cx > 0 ? cx-1 : 0); nx <= cx+1 && nx < width; ++nx) {
+	    if (line[nx] == CANNY_WEAK || line[nx] == CANNY_STRONG) {
+	      line[nx] = CANNY_EDGE;
+	      stack.push(ny*width + nx);
+	    }
+	  }
+	}
+      }
+    }
+  }
+
+  for (size_t y = 0; y < height; ++y) {
+    uint8_t *edgeLine = edges.getLine(y, z);
+    for (size_t x = 0; x < width; ++x)
+      if (edgeLine[x] != CANNY_EDGE) edgeLine[x] = CANNY_NONE;
+  }
+}
+
+/*
+  magKernel fills the magnitude and the 4-bin orientation of one line (see
+  edgeSobelMagnitudeLine), nmsKernel suppresses the non-maxima of the
+  middle line of the magnitude ring and thresholds it into edge codes.
+
+  Every band is split into one strip per thread, like sobelStrips().
+  A strip computes the magnitudes of the rows just above and below it as
+  well, so that its first and last rows see both neighbours; only the
+  hysteresis runs over the whole band. B is the border of the gray
+  windows (see window3x3_split), border its policy object.
+*/
+template <typename B = border_zero, typename T, typename M>
+void canny3x3Frame(cpixmap<T>& gray, cpixmap<uint8_t>& edges, M low, M high, int norm,
+		   void (*magKernel)(const T *, const T *, const T *, M *, uint8_t *, size_t, int, int),
+		   void (*nmsKernel)(const M *, const M *, const M *, const uint8_t *, uint8_t *, size_t, M, M),
+		   const B& border = B())
+{
+  assert(gray.isMatched(edges) && edges.isLinear());
+
+  const size_t width = gray.getWidth(), height = gray.getHeight();
+
+  for (size_t z = 0; z < gray.getBands(); ++z) {
+#pragma omp parallel
+    {
+      size_t y0, y1;
+      stripRows(height, y0, y1);
+      if (y0 < y1) {
+	const size_t ys = y0 > 0 ? y0 - 1 : 0, ye = std::min(y1 + 1, height);
+	window3x3_split<T, B> gray3x3(gray, 1, border);
+	canny_ring<M> mag(width);
+	canny_ring<uint8_t> dir(width);
+
+	gray3x3.draftFrame(gray, z, ys);
+	for (size_t y = ys; y < ye; ++y) {
+	  for (size_t i = 0; i < gray3x3.getSpans(); ++i) {
+	    window3x3_frame<T, B>& span = gray3x3.getSpan(i);
+	    magKernel(span.getPrevLine(), span.getCurrLine(), span.getNextLine(),
+		      mag.getNextLine() + span.getX(), dir.getNextLine() + span.getX(), span.getWidth(), norm, 4);
+	  }
+	  gray3x3.shiftFrame(gray, z);
+	  if (y > y0)
+	    nmsKernel(mag.getPrevLine(), mag.getCurrLine(), mag.getNextLine(),
+		      dir.getCurrLine(), edges.getLine(y-1, z), width, low, high);
+	  mag.shiftLines();
+	  dir.shiftLines();
+	}
+	if (y1 == height) {
+	  mag.clearNextLine();
+	  nmsKernel(mag.getPrevLine(), mag.getCurrLine(), mag.getNextLine(),
+		    dir.getCurrLine(), edges.getLine(height-1, z), width, low, high);
+	}
+      }
+    }
+
+    cannyHysteresis(edges, z);
+  }
+}
+
+#if !defined(USE_SIMD)
+
+/*
+  The pixel survives when it is larger than its neighbour before and not
+  smaller than the one after it along the gradient, so that a ridge two
+  pixels wide leaves a single edge.
+*/
+template <typename M>
+void cannyNmsLine(const M *prevMag, const M *currMag, const M *nextMag,
+		  const uint8_t *dirLine, uint8_t *edgeLine, size_t width, M low, M high)
+{
+  for (size_t x = 0; x < width; ++x) {
+    M m = currMag[x], a, b;
+    switch (dirLine[x] & 3) {
+    case 0: a = currMag[(int)x-1], b = currMag[x+1]; break;
+    case 1: a = prevMag[(int)x-1], b = nextMag[x+1]; break;
+    case 2: a = prevMag[x], b = nextMag[x]; break;
+    default: a = prevMag[x+1], b = nextMag[(int)x-1]; break;
+    }
+    edgeLine[x] = (m > a && m >= b && m >= low) ? (m >= high ? CANNY_STRONG : CANNY_WEAK) : CANNY_NONE;
+  }
+}
+
+template <typename B = border_zero, typename T>
+typename std::enable_if<std::is_unsigned<T>::value, void>::type
+edgeCannyKernel(cpixmap<T>& gray, cpixmap<uint8_t>& edges,
+		typename sobel_magnitude<T>::type low, typename sobel_magnitude<T>::type high,
+		int norm = SOBEL_L2_NORM, const B& border = B())
+{
+  canny3x3Frame<B>(gray, edges, low, high, norm,
+		   edgeSobelMagnitudeLine<T, typename sobel_magnitude<T>::type>,
+		   cannyNmsLine<typename sobel_magnitude<T>::type>, border);
+}
+
+#elif defined(USE_SIMD_DISPATCH)
+// the Canny kernels are declared in sobel.dispatch.hpp
+#else
+# include "canny.SIMD.hpp"
+#endif
@@ -26,229 +26,436 @@
 #include "cregion.hpp"
 #include "cpixmap.hpp"
 
-template <typename T>
-class window3x3_frame;
+/*
+  Border policies of cchunk, chosen at compile time: what the pixels
+  outside the image are, filled in with the lines so that the kernels see
+  a whole window and never branch. A constant border fills in value;
+  the others copy the pixel index(i, n) of a line, or of a column, of n
+  pixels:
+
+  border_constant<V>     VVV|abcd|VVV  (border_zero is V = 0, the default)
+  border_constant_value  vvv|abcd|vvv  (v given at run time)
+  border_replicate       aaa|abcd|ddd
+  border_reflect         dcb|abcd|cba  (the edge pixel is not repeated)
+  border_wrap            bcd|abcd|abc
+
+  The kernels take the policy as an object too, default constructed
+  unless given, which is how border_constant_value passes its v, e.g.
+  edgeSobelKernel(gray, dx, dy, border_constant_value(255)).
+*/
+template <int V>
+struct border_constant {
+  enum { constant = 1, value = V };
+  static int index(int i, int) { return i; }
+};
+
+typedef border_constant<0> border_zero;
+
+struct border_constant_value {
+  enum { constant = 1, value = 0 };
+  border_constant_value(double v = 0) : m_value(v) {}
+  double getValue(void) const { return m_value; }
+  static int index(int i, int) { return i; }
+private:
+  double m_value;
+};
 
-// so called a tile of image
-template <typename T>
+// the pixel value of a constant border
+template <typename B>
+inline double borderValue(const B&) { return B::value; }
+inline double borderValue(const border_constant_value& border) { return border.getValue(); }
+
+struct border_replicate {
+  enum { constant = 0, value = 0 };
+  static int index(int i, int n) { return i < 0 ? 0 : (i >= n ? n-1 : i); }
+};
+
+struct border_reflect {
+  enum { constant = 0, value = 0 };
+  static int index(int i, int n)
+  {
+    if (n == 1) return 0;
+    const int period = 2*(n-1);
+    i %= period;
+    if (i < 0) i += period;
+    return i < n ? i : period - i;
+  }
+};
+
+struct border_wrap {
+  enum { constant = 0, value = 0 };
+  static int index(int i, int n)
+  {
+    i %= n;
+    return i < 0 ? i + n : i;
+  }
+};
+
+template <typename T, int R, typename B = border_zero>
+class window_frame;
+
+/*
+  So called a tile of image: height lines of width pixels with hpadding
+  pixels on both sides, and vpadding lines above and below, read from an
+  image, with the border B outside it. The lines live in a ring of slots:
+  line i of the chunk is in slot (m_head + i) % lines, so
+  shiftByNextLines() moves m_head and reads only the new lines. When the
+  lines of the image are linear and cover the padding contract (see
+  isAliasable), the chunk reads nothing: its lines point at the lines of
+  the image, and the slot 0 holds the constant line that stands for those
+  above and below it.
+*/
+template <typename T, typename B = border_zero>
 class cchunk {
 public:
   cchunk(void);
   cchunk(size_t width, size_t height, size_t hpadding, size_t vpadding);
   virtual ~cchunk(void);
   void setDimension(size_t width, size_t height, size_t hpadding, size_t vpadding);
+  void setBorder(const B& border) { m_border_value = (T)borderValue(border); }
   void draft(const cpixmap<T>& image, size_t x = 0, size_t y = 0, size_t z = 0);
   void shiftByNextLines(size_t lines_to_read, const cpixmap<T>& image, size_t z = 0);
+  bool isAliasable(const cpixmap<T>& image, size_t x = 0) const;
+  T *getLine(size_t i) const;
   T& operator() (int y, int x);
 private:
   void reallocate(size_t lines, size_t stride);
+  void readLine(size_t i, const cpixmap<T>& image, size_t z);
+  void fillConstantLine(T *line);
   size_t m_width;
   size_t m_height;
   size_t m_horizontal_padding;
   size_t m_vertical_padding;
   size_t m_stride;
+  size_t m_lead; // bytes before the left padding, so that pixel 0 is aligned
+  size_t m_lines;
+  size_t m_head; // slot of line 0
   int m_horizontal_start;
   int m_vertical_start;
+  const cpixmap<T> *m_source; // image the lines point at, NULL when they are read
+  size_t m_source_band;
+  T m_border_value; // of a constant border
   uint8_t *m_buffer;
-  T **m_line_buffer;
-  friend class window3x3_frame<T>;
+  template <typename, int, typename> friend class window_frame;
 };
 
-template <typename T>
-cchunk<T>::cchunk(void)
+template <typename T, typename B>
+cchunk<T, B>::cchunk(void)
   : m_width(0),
     m_height(0),
     m_horizontal_padding(0),
     m_vertical_padding(0),
     m_stride(0),
+    m_lead(0),
+    m_lines(0),
+    m_head(0),
     m_horizontal_start(0),
     m_vertical_start(0),
-    m_buffer(NULL),
-    m_line_buffer(NULL) {}
+    m_source(NULL),
+    m_source_band(0),
+    m_border_value((T)B::value),
+    m_buffer(NULL) {}
 
-template <typename T>
-cchunk<T>::cchunk(size_t width, size_t height, size_t hpadding, size_t vpadding)
+template <typename T, typename B>
+cchunk<T, B>::cchunk(size_t width, size_t height, size_t hpadding, size_t vpadding)
   : m_width(0),
     m_height(0),
     m_horizontal_padding(0),
     m_vertical_padding(0),
     m_stride(0),
+    m_lead(0),
+    m_lines(0),
+    m_head(0),
     m_horizontal_start(0),
     m_vertical_start(0),
-    m_buffer(NULL),
-    m_line_buffer(NULL)
+    m_source(NULL),
+    m_source_band(0),
+    m_border_value((T)B::value),
+    m_buffer(NULL)
 {
   setDimension(width, height, hpadding, vpadding);
 }
 
-template <typename T>
-cchunk<T>::~cchunk(void)
+template <typename T, typename B>
+cchunk<T, B>::~cchunk(void)
 {
-  if (m_buffer) delete [] m_buffer;
-  if (m_line_buffer) delete [] m_line_buffer;
+  cpool::getGlobal().release(m_buffer);
 }
 
-template <typename T>
-void cchunk<T>::setDimension(size_t width, size_t height, size_t hpadding, size_t vpadding)
+template <typename T, typename B>
+void cchunk<T, B>::setDimension(size_t width, size_t height, size_t hpadding, size_t vpadding)
 {
   m_width = width;
   m_height = height;
   m_horizontal_padding = hpadding;
   m_vertical_padding = vpadding;
-  m_stride = ALIGN_BYTES((width + (hpadding<<1)) * sizeof(T));
+  m_lead = alignBytes(hpadding * sizeof(T), CPIXMAP_ALIGNMENT) - hpadding * sizeof(T);
+  m_stride = alignBytes(m_lead + (width + (hpadding<<1)) * sizeof(T) + SIMD_PADDING_BYTES, CPIXMAP_ALIGNMENT);
 
   reallocate(height + (vpadding<<1), m_stride);
 }
 
-template <typename T>
-void cchunk<T>::draft(const cpixmap<T>& image, size_t x, size_t y, size_t z)
+/*
+  The lines of image stand for those of the chunk at x when they are
+  linear, own their guards, which are zeros, and these hold the hpadding
+  pixels before x, and the hpadding pixels and the vector of
+  SIMD_PADDING_BYTES loaded at the last of them after x + width. Unless
+  the border is zero, the padding pixels must be pixels of the image.
+*/
+template <typename T, typename B>
+bool cchunk<T, B>::isAliasable(const cpixmap<T>& image, size_t x) const
+{
+  if (!image.isLinear() || !image.ownsBuffer() || !image.getWidth() || !image.getHeight()) return false;
+
+  const size_t guard = image.getLayout().left_guard;
+  const size_t before = guard + x * sizeof(T);
+  const size_t after = image.getLineStride() - guard - (x + m_width) * sizeof(T);
+  if (before < m_horizontal_padding * sizeof(T) ||
+      after + sizeof(T) < m_horizontal_padding * sizeof(T) + SIMD_PADDING_BYTES) return false;
+  return (B::constant && m_border_value == 0) ||
+    (x >= m_horizontal_padding && x + m_width + m_horizontal_padding <= image.getWidth());
+}
+
+template <typename T, typename B>
+void cchunk<T, B>::draft(const cpixmap<T>& image, size_t x, size_t y, size_t z)
 {
   //assert(m_stride == ALIGN_BYTES((image.getWidth()+(m_horizontal_padding<<1))*sizeof(T)));
   assert(m_buffer);
-  assert(m_line_buffer);
 
   m_horizontal_start = x - m_horizontal_padding;
   m_vertical_start = y - m_vertical_padding;
-    
-  size_t lines = m_height + (m_vertical_padding<<1);    
-  std::memset(m_buffer, 0, lines * m_stride);
-    
-  for (size_t i = 0; i < lines; ++i)
-    m_line_buffer[i] = (T *)(m_buffer + i*m_stride);
-
-  size_t hoffset = std::max(m_horizontal_start, 0) - m_horizontal_start;
-  size_t voffset = std::max(m_vertical_start, 0) - m_vertical_start;
-
-  for (size_t i = voffset; i < lines; ++i) {
-    image.readHLine(m_line_buffer[i] + hoffset,
-		    m_width + (m_horizontal_padding<<1) - hoffset,
-		    m_horizontal_start+hoffset,
-		    m_vertical_start+i,
-		    z);
+  m_head = 0;
+
+  if (m_lines && isAliasable(image, x)) {
+    m_source = &image;
+    m_source_band = z;
+    std::memset(m_buffer, 0, m_stride);
+    fillConstantLine((T *)(m_buffer + m_lead));
+    return;
   }
+  m_source = NULL;
+  std::memset(m_buffer, 0, m_lines * m_stride);
+  for (size_t i = 0; i < m_lines; ++i) readLine(i, image, z);
 }
 
-template <typename T>
-void cchunk<T>::shiftByNextLines(size_t lines_to_read, const cpixmap<T>& image, size_t z)
+template <typename T, typename B>
+void cchunk<T, B>::shiftByNextLines(size_t lines_to_read, const cpixmap<T>& image, size_t z)
 {
   //assert(m_stride == ALIGN_BYTES((image.getWidth()+(m_horizontal_padding<<1))*sizeof(T)));
   assert(m_buffer);
-  assert(m_line_buffer);
-    
-  size_t lines_allocated = m_height + (m_vertical_padding<<1);
-    
-  assert(lines_to_read <= lines_allocated);
+  assert(lines_to_read <= m_lines);
 
-  T *temp[lines_to_read];
-  for (size_t i = 0; i < lines_to_read; ++i)
-    temp[i] = m_line_buffer[i];
+  m_vertical_start += lines_to_read;
+  if (m_source) {
+    assert(m_source == &image && m_source_band == z);
+    return;
+  }
 
-  for (size_t i = lines_to_read; i < lines_allocated; ++i)
-    m_line_buffer[i - lines_to_read] = m_line_buffer[i];
+  m_head = (m_head + lines_to_read) % m_lines;
+  for (size_t i = m_lines - lines_to_read; i < m_lines; ++i) readLine(i, image, z);
+}
 
-  for (size_t i = 0; i < lines_to_read; ++i)
-    m_line_buffer[lines_allocated - lines_to_read + i] = temp[i];
+// line i of the chunk, from its left padding on
+template <typename T, typename B>
+inline T *cchunk<T, B>::getLine(size_t i) const
+{
+  if (m_source) {
+    int y = m_vertical_start + (int)i;
+    if (y < 0 || (size_t)y >= m_source->getHeight()) {
+      if (B::constant) return (T *)(m_buffer + m_lead);
+      y = B::index(y, (int)m_source->getHeight());
+    }
+    return m_source->getLine(y, m_source_band) + m_horizontal_start;
+  }
+  size_t slot = m_head + i;
+  if (slot >= m_lines) slot -= m_lines;
+  return (T *)(m_buffer + slot*m_stride + m_lead);
+}
 
-  m_vertical_start += lines_to_read;
+/*
+  Line i: one bulk copy (see cpixmap::readHLine) of the pixels in the
+  image, of the line B gives for a line outside it, then the border
+  pixels on either side.
+*/
+template <typename T, typename B>
+void cchunk<T, B>::readLine(size_t i, const cpixmap<T>& image, size_t z)
+{
+  const int width = (int)image.getWidth(), height = (int)image.getHeight();
+  const int span = (int)(m_width + (m_horizontal_padding<<1));
+  T *line = getLine(i);
+  int y = m_vertical_start + (int)i;
 
-  size_t hoffset = std::max(m_horizontal_start, 0) - m_horizontal_start;
-     
-  for (size_t i = 0; i < lines_to_read; ++i) {
-    size_t voffset = lines_allocated - lines_to_read + i;
-    size_t line = (size_t)(m_vertical_start + voffset);
-    if (line < image.getHeight()) {
-      image.readHLine(m_line_buffer[voffset] + hoffset,
-		      m_width + (m_horizontal_padding<<1) - hoffset,
-		      m_horizontal_start + hoffset,
-		      m_vertical_start + voffset,
-		      z);
-    } else {
-      std::memset(m_line_buffer[voffset], 0, m_stride);
+  if (y < 0 || y >= height || !width) {
+    if (B::constant || !width || !height) {
+      fillConstantLine(line);
+      return;
     }
+    y = B::index(y, height);
   }
+  const int x0 = std::max(m_horizontal_start, 0), x1 = std::min(m_horizontal_start + span, width);
+  if (x0 < x1) image.readHLine(line + (x0 - m_horizontal_start), x1 - x0, x0, y, z);
+  for (int x = m_horizontal_start; x < std::min(0, m_horizontal_start + span); ++x)
+    line[x - m_horizontal_start] = B::constant ? m_border_value : image.getPixel(B::index(x, width), y, z);
+  for (int x = std::max(width, m_horizontal_start); x < m_horizontal_start + span; ++x)
+    line[x - m_horizontal_start] = B::constant ? m_border_value : image.getPixel(B::index(x, width), y, z);
+}
+
+// the padding and the pixels of a line outside the image, under a constant border
+template <typename T, typename B>
+void cchunk<T, B>::fillConstantLine(T *line)
+{
+  std::fill(line, line + m_width + (m_horizontal_padding<<1), m_border_value);
 }
 
-template <typename T>
-T& cchunk<T>::operator()(int y, int x)
+template <typename T, typename B>
+T& cchunk<T, B>::operator()(int y, int x)
 {
-  assert(y >= m_vertical_start && y < m_vertical_start + (int)(m_height + (m_vertical_padding<<1)));
+  assert(y >= m_vertical_start && y < m_vertical_start + (int)m_lines);
   assert(x >= m_horizontal_start && x < m_horizontal_start + (int)(m_width + (m_horizontal_padding<<1)));
     
-  return *(m_line_buffer[y-m_vertical_start] + x-m_horizontal_start);
+  return *(getLine(y-m_vertical_start) + x-m_horizontal_start);
 }
 
-template <typename T>
-void cchunk<T>::reallocate(size_t lines, size_t stride)
+template <typename T, typename B>
+void cchunk<T, B>::reallocate(size_t lines, size_t stride)
 {
-  if (m_buffer) delete [] m_buffer;
-  if (m_line_buffer) delete [] m_line_buffer;
-  m_buffer = new uint8_t[lines * stride];
-  m_line_buffer = new T*[lines];
+  cpool::getGlobal().release(m_buffer);
+  m_lines = lines;
+  m_buffer = (uint8_t *)cpool::getGlobal().allocate(lines * stride, CPIXMAP_ALIGNMENT);
 }
 
-template <typename T>
+template <typename T, typename B = border_zero>
 class cslice {
 public:
-  cslice(void) : m_base(NULL) { m_base = new cchunk<T>; }
+  cslice(void) {}
   cslice(const cpixmap<T>& img, size_t lines, size_t hpadding, size_t vpadding)
-    : m_base(NULL)
   {
-    m_base = new cchunk<T>;
-    m_base->setDimension(img.getWidth(), lines, hpadding, vpadding);
+    m_base.setDimension(img.getWidth(), lines, hpadding, vpadding);
   }
-  virtual ~cslice(void) { delete m_base; }
+  virtual ~cslice(void) {}
   void setSlice(const cpixmap<T>& img, size_t lines, size_t hpadding, size_t vpadding)
   {
-    m_base->setDimension(img.getWidth(), lines, hpadding, vpadding);
+    m_base.setDimension(img.getWidth(), lines, hpadding, vpadding);
   }
-  void draftSlice(const cpixmap<T>& img, size_t z = 0) { m_base->draft(img, 0, 0, z); }
+  void setBorder(const B& border) { m_base.setBorder(border); }
+  void draftSlice(const cpixmap<T>& img, size_t z = 0) { m_base.draft(img, 0, 0, z); }
   void shiftSlice(size_t lines_to_read, const cpixmap<T>& img, size_t z = 0)
   {
-    m_base->shiftByNextLines(lines_to_read, img, z);
+    m_base.shiftByNextLines(lines_to_read, img, z);
   }
-  T& operator()(int y, int x) { return (*m_base)(y, x); }
+  T& operator()(int y, int x) { return m_base(y, x); }
 private:
-  cchunk<T> *m_base;
+  cchunk<T, B> m_base;
 };
 
-template <typename T>
-class window3x3_frame {
+/*
+  The window of a stencil of radius R: the 2R+1 lines around the current
+  row, each with R pixels of padding on either side, or the rows + 2R
+  lines around a block of rows (see setColumns), which shiftFrame() moves
+  on by rows lines at once. getLine(dy) is the line dy rows from the
+  current (first) one, -R <= dy < rows + R, from its pixel 0 on; a line
+  kernel reads the pixels [-R, width + R) of it.
+*/
+template <typename T, int R, typename B>
+class window_frame {
 public:
-  window3x3_frame(void) : m_base(NULL) { m_base = new cchunk<T>; }
-  window3x3_frame(const cpixmap<T>& img)
-    : m_base(NULL)
+  enum { radius = R, lines = 2*R + 1 };
+  window_frame(void) : m_x(0) {}
+  window_frame(const cpixmap<T>& img) : m_x(0) { m_base.setDimension(img.getWidth(), 1, R, R); }
+  window_frame(const cpixmap_view<T>& roi) : m_x(0) { m_base.setDimension(roi.getWidth(), 1, R, R); }
+  virtual ~window_frame(void) {}
+  void setFrame(const cpixmap<T>& img) { setColumns(0, img.getWidth()); }
+  // the columns [x, x + width) of an image or a view, rows at a time
+  void setColumns(size_t x, size_t width, size_t rows = 1) { m_x = x; m_base.setDimension(width, rows, R, R); }
+  void setBorder(const B& border) { m_base.setBorder(border); }
+  void draftFrame(const cpixmap<T>& img, size_t z = 0, size_t y = 0) { m_base.draft(img, m_x, y, z); }
+  void shiftFrame(const cpixmap<T>& img, size_t z = 0) { m_base.shiftByNextLines(getRows(), img, z); }
+  bool isAliasable(const cpixmap<T>& img) const { return m_base.isAliasable(img, m_x); }
+  // a view is read from its parent, so the halo around it holds the parent pixels
+  void draftFrame(const cpixmap_view<T>& roi, size_t z = 0, size_t y = 0)
   {
-    m_base = new cchunk<T>;
-    m_base->setDimension(img.getWidth(), 1, 1, 1);
+    m_base.draft(roi.getParent(), roi.getXOrigin() + m_x, roi.getYOrigin() + y, roi.getZOrigin() + z);
   }
-  virtual ~window3x3_frame(void) { delete m_base; }
-  void setFrame(const cpixmap<T>& img) { m_base->setDimension(img.getWidth(), 1, 1, 1); }
-  void draftFrame(const cpixmap<T>& img, size_t z = 0) { m_base->draft(img, 0, 0, z); }
-  void shiftFrame(const cpixmap<T>& img, size_t z = 0) { m_base->shiftByNextLines(1, img, z); }
-  T* getPrevLine(void) { return m_base->m_line_buffer[0] - m_base->m_horizontal_start; }
-  T* getCurrLine(void) { return m_base->m_line_buffer[1] - m_base->m_horizontal_start; }
-  T* getNextLine(void) { return m_base->m_line_buffer[2] - m_base->m_horizontal_start; }
-  T& operator() (int y, int x) { return (*m_base)(y, x); }
+  void shiftFrame(const cpixmap_view<T>& roi, size_t z = 0)
+  {
+    m_base.shiftByNextLines(getRows(), roi.getParent(), roi.getZOrigin() + z);
+  }
+  bool isAliasable(const cpixmap_view<T>& roi) const
+  {
+    return m_base.isAliasable(roi.getParent(), roi.getXOrigin() + m_x);
+  }
+  size_t getX(void) const { return m_x; }
+  size_t getWidth(void) const { return m_base.m_width; }
+  size_t getRows(void) const { return m_base.m_height; }
+  T* getLine(int dy) const { return m_base.getLine(R + dy) + R; }
+  T* getPrevLine(void) const { return getLine(-1); }
+  T* getCurrLine(void) const { return getLine(0); }
+  T* getNextLine(void) const { return getLine(1); }
+  // the lines -R..rows-1+R, for a line kernel of radius R
+  void getLines(const T **line) const
+  {
+    for (int dy = -R; dy < (int)getRows() + R; ++dy) line[R + dy] = getLine(dy);
+  }
+  T& operator() (int y, int x) { return m_base(y, x); }
 private:
-  cchunk<T> *m_base;
-  friend class cchunk<T>;
+  cchunk<T, B> m_base;
+  size_t m_x;
 };
 
-template <typename T>
-class window5x5_frame {
+template <typename T, typename B = border_zero>
+using window3x3_frame = window_frame<T, 1, B>;
+template <typename T, typename B = border_zero>
+using window5x5_frame = window_frame<T, 2, B>;
+
+/*
+  The windows of radius R of an image, split by columns. When the window
+  over the whole width would copy the lines, as under a border other than
+  zero, but the one over the inner columns [R, width-R) aliases them (see
+  cchunk::isAliasable), the inner columns are read in place and only the
+  R first and the R last columns go through copied windows. Otherwise one
+  window covers the whole width. The spans are in the order of their
+  columns, so a kernel that stores a whole vector past its span has the
+  stray pixels overwritten by the next span.
+*/
+template <typename T, int R, typename B = border_zero>
+class window_split {
 public:
-  window5x5_frame(void) : m_base(NULL) { m_base = new cchunk<T>; }
-  window5x5_frame(const cpixmap<T>& img)
-    : m_base(NULL)
+  template <typename I>
+  window_split(const I& img, size_t rows = 1, const B& border = B());
+  virtual ~window_split(void) {}
+  template <typename I>
+  void draftFrame(const I& img, size_t z = 0, size_t y = 0)
+  {
+    for (size_t i = 0; i < m_spans; ++i) m_window[i].draftFrame(img, z, y);
+  }
+  template <typename I>
+  void shiftFrame(const I& img, size_t z = 0)
   {
-    m_base = new cchunk<T>;
-    m_base->setDimension(img.getWidth(), 1, 2, 2);
+    for (size_t i = 0; i < m_spans; ++i) m_window[i].shiftFrame(img, z);
   }
-  virtual ~window5x5_frame(void) { delete m_base; }
-  void setFrame(const cpixmap<T>& img) { m_base->setDimension(img.getWidth(), 1, 2, 2); }
-  void draftFrame(const cpixmap<T>& img, size_t z = 0) { m_base->draft(img, 0, 0, z); }
-  void shiftFrame(const cpixmap<T>& img, size_t z = 0) { m_base->shiftByNextLines(1, img, z); }
-  T& operator() (int y, int x) { return (*m_base)(y, x); }
+  size_t getSpans(void) const { return m_spans; }
+  window_frame<T, R, B>& getSpan(size_t i) { return m_window[i]; }
 private:
-  cchunk<T> *m_base;
+  window_frame<T, R, B> m_window[3];
+  size_t m_spans;
 };
+
+template <typename T, int R, typename B>
+template <typename I>
+window_split<T, R, B>::window_split(const I& img, size_t rows, const B& border)
+  : m_spans(1)
+{
+  const size_t width = img.getWidth();
+
+  for (size_t i = 0; i < 3; ++i) m_window[i].setBorder(border);
+  m_window[0].setColumns(0, width, rows);
+  if (width <= 2*R || m_window[0].isAliasable(img)) return;
+  m_window[1].setColumns(R, width - 2*R, rows);
+  if (!m_window[1].isAliasable(img)) return;
+  m_window[0].setColumns(0, R, rows);
+  m_window[2].setColumns(width - R, R, rows);
+  m_spans = 3;
+}
+
+template <typename T, typename B = border_zero>
+using window3x3_split = window_split<T, 1, B>;
@@ -23,10 +23,167 @@
 //#include <cmemory>
 #include <cassert>
 #include <cstdint>
+#include <algorithm>
+#ifdef _OPENMP
+# include <omp.h>
+#endif
+#if defined(__SSSE3__)
+# include <tmmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+# include <arm_neon.h>
+#endif
 
 #include "cregion.hpp"
+#include "cpool.hpp"
 
 #define QWORD_ALIGN(bytes) (((bytes) + 7) & -8)
+#ifndef ALIGN_BYTES
+# define ALIGN_BYTES(bytes) QWORD_ALIGN(bytes)
+#endif
+
+/*
+  Padding contract of the SIMD kernels. They load from the lines of a
+  cchunk (window3x3_frame), which end with SIMD_PADDING_BYTES of zeros
+  past their right padding, so a whole vector of up to 512 bits can be
+  loaded at any pixel of such a line. They store into cpixmap lines, whose
+  guards depend on their cpixmap_layout, so the last vector of a line is
+  always stored partially.
+*/
+#define SIMD_PADDING_BYTES 64
+
+/*
+  Default layout of the cpixmap lines: the first pixel of every line is
+  aligned to CPIXMAP_ALIGNMENT bytes, and every line has
+  CPIXMAP_GUARD_BYTES of zeros before and after it, so that a kernel may
+  read a pixel, or a vector, past either end of a line.
+*/
+#ifndef CPIXMAP_ALIGNMENT
+# define CPIXMAP_ALIGNMENT 64
+#endif
+#ifndef CPIXMAP_GUARD_BYTES
+# define CPIXMAP_GUARD_BYTES SIMD_PADDING_BYTES
+#endif
+
+/*
+  CPIXMAP_PLANAR stores every band as a plane of its own lines.
+  CPIXMAP_INTERLEAVED stores the bands of a pixel next to each other, like
+  packed BGR or BGRA frames, so a line of a band has a pixel stride of
+  getBands() elements. CPIXMAP_TILED stores every band as a plane of
+  tile_width x tile_height tiles, each tile row after row and the tiles of
+  a band row-major, so the pixels around a pixel, above and below it
+  included, are in a few cache lines and one page; a line is then
+  contiguous only within a tile (see getLine). The kernels read
+  interleaved and tiled images as they are, gathering one line at a time
+  into their window (see readHLine), but write linear images only.
+*/
+enum cpixmap_packing {
+  CPIXMAP_PLANAR,
+  CPIXMAP_INTERLEAVED,
+  CPIXMAP_TILED
+};
+
+// default tile width and height in pixels, powers of two
+#ifndef CPIXMAP_TILE_SIZE
+# define CPIXMAP_TILE_SIZE 64
+#endif
+
+struct cpixmap_layout {
+  cpixmap_layout(size_t alignment = CPIXMAP_ALIGNMENT,
+		 size_t left_guard = CPIXMAP_GUARD_BYTES, size_t right_guard = CPIXMAP_GUARD_BYTES,
+		 cpixmap_packing packing = CPIXMAP_PLANAR)
+    : alignment(alignment), left_guard(left_guard), right_guard(right_guard), packing(packing),
+      tile_width(CPIXMAP_TILE_SIZE), tile_height(CPIXMAP_TILE_SIZE) {}
+  cpixmap_layout(cpixmap_packing packing,
+		 size_t tile_width = CPIXMAP_TILE_SIZE, size_t tile_height = CPIXMAP_TILE_SIZE)
+    : alignment(CPIXMAP_ALIGNMENT), left_guard(CPIXMAP_GUARD_BYTES), right_guard(CPIXMAP_GUARD_BYTES),
+      packing(packing), tile_width(tile_width), tile_height(tile_height) {}
+  size_t alignment;	// of the first pixel of every line, a power of two
+  size_t left_guard;	// bytes before every line (the first tile when tiled), rounded up to alignment
+  size_t right_guard;	// bytes after every line (the last tile when tiled)
+  cpixmap_packing packing;
+  size_t tile_width;	// pixels of a tile, a power of two, when packing is CPIXMAP_TILED
+  size_t tile_height;	// lines of a tile, a power of two
+};
+
+/*
+  dst[j] = pixels[j*bands + z] for j < n, with SIMD shuffles for 8-bit
+  samples. A block of 16 pixels is loaded as bands whole vectors from the
+  first band on, so nothing past the last pixel is read, and the buffer
+  needs no guards. The pshufb path is taken only where cpixmap itself is
+  compiled with -mssse3 or above: a dispatched build compiles it into the
+  -msse2 object only (see sobel.dispatch.cpp), so there the interleaved
+  lines go through the scalar loop.
+*/
+template <typename T>
+static inline void deinterleaveLine(T *dst, const T *pixels, size_t n, size_t bands, size_t z)
+{
+  for (size_t j = 0; j < n; ++j) dst[j] = pixels[j*bands + z];
+}
+
+static inline void deinterleaveLine(uint8_t *dst, const uint8_t *pixels, size_t n, size_t bands, size_t z)
+{
+  size_t j = 0;
+#if defined(__SSSE3__)
+  if (bands >= 2 && bands <= 4) {
+    // byte i of the result is byte bands*i + z of the block, in vector k
+    // at 16k; the other vectors contribute zeros (-128)
+    int8_t masks[4][16];
+    __m128i m[4];
+    for (size_t k = 0; k < bands; ++k) {
+      for (int i = 0; i < 16; ++i) {
+	int at = (int)(bands*i + z) - 16*(int)k;
+	masks[k][i] = (int8_t)(at >= 0 && at < 16 ? at : -128);
+      }
+      m[k] = _mm_loadu_si128((const __m128i *)masks[k]);
+    }
+    for (; j + 16 <= n; j += 16) {
+      const uint8_t *p = pixels + j*bands;
+      __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)p), m[0]);
+      for (size_t k = 1; k < bands; ++k)
+	v = _mm_or_si128(v, _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 16*k)), m[k]));
+      _mm_storeu_si128((__m128i *)(dst + j), v);
+    }
+  }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  if (bands == 2) {
+    for (; j + 16 <= n; j += 16) vst1q_u8(dst + j, vld2q_u8(pixels + j*2).val[z]);
+  } else if (bands == 3) {
+    for (; j + 16 <= n; j += 16) vst1q_u8(dst + j, vld3q_u8(pixels + j*3).val[z]);
+  } else if (bands == 4) {
+    for (; j + 16 <= n; j += 16) vst1q_u8(dst + j, vld4q_u8(pixels + j*4).val[z]);
+  }
+#endif
+  for (; j < n; ++j) dst[j] = pixels[j*bands + z];
+}
+
+/*
+  How a cpixmap initializes the buffers it allocates. CPIXMAP_ZEROED
+  clears all of it. CPIXMAP_UNINITIALIZED clears only the guards and
+  leaves the pixels to the kernel that is about to write them, e.g. dx and
+  dy. CPIXMAP_FIRST_TOUCH clears the pixels too, but every line from the
+  OpenMP thread whose strip (see stripRows) holds it, so that on a NUMA
+  machine its pages end up on the node of the thread that processes them.
+*/
+enum cpixmap_init {
+  CPIXMAP_ZEROED,
+  CPIXMAP_UNINITIALIZED,
+  CPIXMAP_FIRST_TOUCH
+};
+
+/*
+  Rows [y0, y1) of the horizontal strip of the calling OpenMP thread, one
+  strip per thread of the enclosing parallel region.
+*/
+inline void stripRows(size_t height, size_t& y0, size_t& y1)
+{
+  size_t strips = 1, strip = 0;
+#ifdef _OPENMP
+  strips = (size_t)omp_get_num_threads();
+  strip = (size_t)omp_get_thread_num();
+#endif
+  y0 = height * strip / strips;
+  y1 = height * (strip + 1) / strips;
+}
 
 template <typename T>
 class cpixmap : public cregion<size_t> {
@@ -34,12 +191,27 @@ class cpixmap : public cregion<size_t> {
 public:
   cpixmap(void);
   cpixmap(size_t w, size_t h, size_t b = 1);
+  cpixmap(size_t w, size_t h, size_t b, const cpixmap_layout& layout);
+  cpixmap(size_t w, size_t h, size_t b, cpixmap_init init, const cpixmap_layout& layout = cpixmap_layout());
+  cpixmap(T *buffer, size_t w, size_t h, size_t line_stride, size_t b = 1, size_t band_stride = 0);
+  cpixmap(T *buffer, size_t w, size_t h, size_t line_stride, size_t b, cpixmap_packing packing);
   cpixmap(const cpixmap& pixmap);
+  cpixmap(cpixmap&& pixmap);
   cpixmap(const cregion& dim);
   virtual ~cpixmap(void);
   T *getImage(size_t z = 0) const;
   T *getLine(size_t y, size_t z = 0) const;
   T& getPixel(size_t x, size_t y, size_t z = 0) const;
+  size_t getLineStride(void) const { return m_height_stride; }
+  size_t getPixelStride(void) const { return m_pixel_stride; }
+  bool isInterleaved(void) const { return m_pixel_stride != sizeof(T); }
+  bool isTiled(void) const { return m_layout.packing == CPIXMAP_TILED; }
+  // every line of a band is getWidth() contiguous pixels, as the kernels write them
+  bool isLinear(void) const { return !isInterleaved() && !isTiled(); }
+  const cpixmap_layout& getLayout(void) const { return m_layout; }
+  bool ownsBuffer(void) const { return m_allocation != NULL; }
+  cpixmap_init getInit(void) const { return m_init; }
+  void setInit(cpixmap_init init) { m_init = init; } // for the next allocations
   void putPixel(T val, size_t x, size_t y, size_t z = 0);
   void setResolution(size_t w, size_t h, size_t b = 1);
   bool isMatched(const cpixmap& pixmap) const;
@@ -51,9 +223,10 @@ public:
   void flipVertically(void);
   void lshiftPixel(size_t bits = 1);
   void rshiftPixel(size_t bits = 1);
-  //  cpixmap<T> operator=(const cpixmap<T>& m);
-  T& operator() (size_t z, size_t y, size_t x) { return *(T *)(m_buffer + z*m_band_stride + y*m_height_stride + x*sizeof(T)); }
-  T& operator() (size_t y, size_t x) { return *(T *)(m_buffer + y*m_height_stride + x*sizeof(T)); }
+  cpixmap& operator=(const cpixmap& pixmap);
+  cpixmap& operator=(cpixmap&& pixmap);
+  T& operator() (size_t z, size_t y, size_t x) { return *(T *)(m_buffer + getPixelOffset(x, y, z)); }
+  T& operator() (size_t y, size_t x) { return *(T *)(m_buffer + getPixelOffset(x, y, 0)); }
 
   enum RGB_COLOR {
     BLUE_BAND = 0,
@@ -64,35 +237,108 @@ public:
   
 private:
   //void reallocate(size_t w, size_t h);
-  void reallocate(size_t w, size_t h, size_t b = 0);
+  void reallocate(size_t w, size_t h, size_t b, cpixmap_init init);
+  void clearGuards(size_t line_bytes, size_t lines);
+  void touchStrips(size_t height, size_t row_lines, size_t row_bytes, size_t planes, size_t plane_bytes, size_t bytes);
+  size_t getPixelOffset(size_t x, size_t y, size_t z) const;
+  size_t getPlanes(void) const { return isInterleaved() ? 1 : m_bands; }
+  size_t getAllocatedBytes(void) const
+  {
+    if (isTiled()) return m_layout.left_guard + m_bands * m_band_stride + m_layout.right_guard;
+    return m_layout.left_guard + getPlanes() * m_height * m_height_stride;
+  }
+  void takeBuffer(cpixmap& pixmap);
+  void copyPixels(const cpixmap& pixmap);
+  cpixmap_layout m_layout;
+  cpixmap_init m_init;
   size_t m_height_stride;
   size_t m_band_stride;
-  uint8_t *m_buffer;
+  size_t m_pixel_stride;
+  size_t m_tile_stride; // bytes of a row of tiles, 0 when not tiled
+  uint8_t *m_allocation; // NULL when the buffer is external
+  uint8_t *m_buffer; // first pixel, m_layout.left_guard bytes into m_allocation
 };
 
 template <typename T> 
 cpixmap<T>::cpixmap(void)
-  : m_height_stride(0), m_band_stride(0), m_buffer(NULL) {}
+  : m_init(CPIXMAP_ZEROED), m_height_stride(0), m_band_stride(0), m_pixel_stride(sizeof(T)), m_tile_stride(0), m_allocation(NULL), m_buffer(NULL) {}
 
 template <typename T>
 cpixmap<T>::cpixmap(size_t w, size_t h, size_t b)
-  : cregion(w, h, b), m_height_stride(0), m_band_stride(0), m_buffer(NULL)
+  : cregion(w, h, b), m_init(CPIXMAP_ZEROED),
+    m_height_stride(0), m_band_stride(0), m_pixel_stride(sizeof(T)), m_tile_stride(0), m_allocation(NULL), m_buffer(NULL)
 {
   //setResolution(w, h, b);
-  reallocate(w, h, b);
+  reallocate(w, h, b, m_init);
 }
 
+template <typename T>
+cpixmap<T>::cpixmap(size_t w, size_t h, size_t b, const cpixmap_layout& layout)
+  : cregion(w, h, b), m_layout(layout), m_init(CPIXMAP_ZEROED),
+    m_height_stride(0), m_band_stride(0), m_pixel_stride(sizeof(T)), m_tile_stride(0), m_allocation(NULL), m_buffer(NULL)
+{
+  reallocate(w, h, b, m_init);
+}
+
+template <typename T>
+cpixmap<T>::cpixmap(size_t w, size_t h, size_t b, cpixmap_init init, const cpixmap_layout& layout)
+  : cregion(w, h, b), m_layout(layout), m_init(init),
+    m_height_stride(0), m_band_stride(0), m_pixel_stride(sizeof(T)), m_tile_stride(0), m_allocation(NULL), m_buffer(NULL)
+{
+  reallocate(w, h, b, m_init);
+}
+
+/*
+  Wraps a buffer the caller owns, e.g. a capture ring buffer, an mmap'ed
+  file or shared memory, with line_stride bytes between the lines and
+  band_stride bytes between the bands (h * line_stride by default). Nothing
+  is allocated, cleared or freed, and no guards are needed around the
+  lines: the kernels store their last vector of a line partially. The
+  buffer must outlive the pixmap, or at least its next setResolution(),
+  after which the pixmap allocates a buffer of its own.
+*/
+template <typename T>
+cpixmap<T>::cpixmap(T *buffer, size_t w, size_t h, size_t line_stride, size_t b, size_t band_stride)
+  : cregion(w, h, b), m_init(CPIXMAP_ZEROED), m_height_stride(line_stride), m_band_stride(band_stride ? band_stride : h * line_stride),
+    m_pixel_stride(sizeof(T)), m_tile_stride(0), m_allocation(NULL), m_buffer((uint8_t *)buffer)
+{
+  assert(line_stride >= w * sizeof(T));
+}
+
+// an external buffer of b bands, interleaved like a packed BGR frame, or planar
+template <typename T>
+cpixmap<T>::cpixmap(T *buffer, size_t w, size_t h, size_t line_stride, size_t b, cpixmap_packing packing)
+  : cregion(w, h, b), m_layout(packing), m_init(CPIXMAP_ZEROED), m_height_stride(line_stride),
+    m_band_stride(packing == CPIXMAP_INTERLEAVED ? sizeof(T) : h * line_stride),
+    m_pixel_stride(packing == CPIXMAP_INTERLEAVED ? b * sizeof(T) : sizeof(T)),
+    m_tile_stride(0), m_allocation(NULL), m_buffer((uint8_t *)buffer)
+{
+  assert(packing != CPIXMAP_TILED);
+  assert(line_stride >= w * m_pixel_stride);
+}
+
+// deep copy into a buffer of its own, guards included
 template <typename T>
 cpixmap<T>::cpixmap(const cpixmap& pixmap)
-  : m_height_stride(0), m_band_stride(0), m_buffer(NULL)
+  : cregion(pixmap), m_layout(pixmap.m_layout), m_init(pixmap.m_init),
+    m_height_stride(0), m_band_stride(0), m_pixel_stride(sizeof(T)), m_tile_stride(0), m_allocation(NULL), m_buffer(NULL)
 {
-  const cregion dim = static_cast<const cregion>(pixmap);
-  setResolution(dim.getWidth(), dim.getHeight(), dim.getBands());
+  reallocate(m_width, m_height, m_bands, CPIXMAP_UNINITIALIZED);
+  copyPixels(pixmap);
+}
+
+// takes the buffer of pixmap, which is left empty
+template <typename T>
+cpixmap<T>::cpixmap(cpixmap&& pixmap)
+  : cregion(pixmap), m_layout(pixmap.m_layout), m_init(pixmap.m_init),
+    m_height_stride(0), m_band_stride(0), m_pixel_stride(sizeof(T)), m_tile_stride(0), m_allocation(NULL), m_buffer(NULL)
+{
+  takeBuffer(pixmap);
 }
   
 template <typename T>
 cpixmap<T>::cpixmap(const cregion& dim)
-  : m_height_stride(0), m_band_stride(0), m_buffer(NULL)
+  : m_init(CPIXMAP_ZEROED), m_height_stride(0), m_band_stride(0), m_pixel_stride(sizeof(T)), m_tile_stride(0), m_allocation(NULL), m_buffer(NULL)
 {
   setResolution(dim.getWidth(), dim.getHeight(), dim.getBands());
 }
@@ -100,35 +346,190 @@ cpixmap<T>::cpixmap(const cregion& dim)
 template <typename T>
 cpixmap<T>::~cpixmap(void)
 {
-  //std::cout << static_cast<void *>(this) << " paraent" <<std::endl;
-  //std::cout << static_cast<void *>(m_buffer) << " is freed!" << std::endl;
-  if (m_buffer) delete [] reinterpret_cast<double *>(m_buffer);
-  m_buffer = NULL;
+  cpool::getGlobal().release(m_allocation);
+  m_allocation = m_buffer = NULL;
 }
 
 template <typename T>
 void cpixmap<T>::setResolution(size_t w, size_t h, size_t b)
 {
   cregion::setResolution(w, h, b);
-  reallocate(w, h, b);
+  reallocate(w, h, b, m_init);
 }
 
+/*
+  Copies the pixels of pixmap, and its dimension and origin. The buffer,
+  own or external, is kept when it has the resolution of pixmap, so
+  assigning frames of one size again and again never allocates; otherwise
+  a buffer with the layout of pixmap is allocated.
+*/
 template <typename T>
-void cpixmap<T>::reallocate(size_t w, size_t h, size_t b)
+cpixmap<T>& cpixmap<T>::operator=(const cpixmap& pixmap)
 {
-  size_t bytes;
+  if (this == &pixmap) return *this;
 
-  m_height_stride = QWORD_ALIGN(w * sizeof(T)); //+ 7) & -8; // 8 bytes alignment
-  m_band_stride = h * m_height_stride;
-  
-  bytes = b * m_band_stride;
+  if (!m_buffer || !isResolutionMatched(pixmap)) {
+    m_layout = pixmap.m_layout;
+    reallocate(pixmap.m_width, pixmap.m_height, pixmap.m_bands, CPIXMAP_UNINITIALIZED);
+  }
+  cregion::operator=(pixmap);
+  copyPixels(pixmap);
+  return *this;
+}
+
+template <typename T>
+cpixmap<T>& cpixmap<T>::operator=(cpixmap&& pixmap)
+{
+  if (this == &pixmap) return *this;
+
+  cregion::operator=(pixmap);
+  m_layout = pixmap.m_layout;
+  m_init = pixmap.m_init;
+  cpool::getGlobal().release(m_allocation);
+  takeBuffer(pixmap);
+  return *this;
+}
+
+/*
+  One memcpy when both buffers have the same layout, else line by line
+  into a linear pixmap (see readHLine), or pixel by pixel.
+*/
+template <typename T>
+void cpixmap<T>::copyPixels(const cpixmap& pixmap)
+{
+  if (ownsBuffer() && pixmap.ownsBuffer() && m_layout.left_guard == pixmap.m_layout.left_guard &&
+      m_height_stride == pixmap.m_height_stride && m_band_stride == pixmap.m_band_stride &&
+      m_pixel_stride == pixmap.m_pixel_stride && m_tile_stride == pixmap.m_tile_stride) {
+    std::memcpy(m_allocation, pixmap.m_allocation, getAllocatedBytes());
+    return;
+  }
+  if (!m_width) return;
+  for (size_t z = 0; z < m_bands; ++z)
+    for (size_t y = 0; y < m_height; ++y) {
+      if (isLinear()) pixmap.readHLine(getLine(y, z), m_width, 0, y, z);
+      else for (size_t x = 0; x < m_width; ++x) getPixel(x, y, z) = pixmap.getPixel(x, y, z);
+    }
+}
 
-  if (m_buffer) delete (double *)m_buffer;
-  m_buffer = reinterpret_cast<uint8_t *>(new double[(bytes + 7) / 8]);
-  assert(m_buffer);
-  memset(m_buffer, 0, bytes);
-  //std::cout << static_cast<void *>(this) << " paraent" <<std::endl;
-  //std::cout << bytes << " bytes are allocated at " << static_cast<void *>(m_buffer) << std::endl;
+template <typename T>
+void cpixmap<T>::takeBuffer(cpixmap& pixmap)
+{
+  m_height_stride = pixmap.m_height_stride;
+  m_band_stride = pixmap.m_band_stride;
+  m_pixel_stride = pixmap.m_pixel_stride;
+  m_tile_stride = pixmap.m_tile_stride;
+  m_allocation = pixmap.m_allocation;
+  m_buffer = pixmap.m_buffer;
+  pixmap.cregion::setResolution(0, 0, 0);
+  pixmap.m_height_stride = pixmap.m_band_stride = pixmap.m_tile_stride = 0;
+  pixmap.m_pixel_stride = sizeof(T);
+  pixmap.m_allocation = pixmap.m_buffer = NULL;
+}
+
+/*
+  Every line takes left guard + pixels + right guard bytes, rounded up to
+  the alignment, so the first pixel of every line stays aligned, and the
+  left guard of the first line comes before it. A tiled band is rows of
+  tiles of tile_height lines of tile_width pixels, with no guards but the
+  one before the first and the one after the last tile, and its edge
+  tiles padded to whole tiles. The buffer comes from cpool::getGlobal(),
+  so a pixmap of the same geometry gets a recycled one. init tells how it
+  is cleared (see cpixmap_init).
+*/
+template <typename T>
+void cpixmap<T>::reallocate(size_t w, size_t h, size_t b, cpixmap_init init)
+{
+  size_t bytes, planes = b, rows = h, row_lines = 1, row_bytes, plane_bytes;
+
+  m_layout.left_guard = alignBytes(m_layout.left_guard, m_layout.alignment);
+  m_pixel_stride = sizeof(T);
+  m_tile_stride = 0;
+  if (m_layout.packing == CPIXMAP_TILED) {
+    const size_t tw = m_layout.tile_width, th = m_layout.tile_height;
+    assert(tw && !(tw & (tw-1)) && th && !(th & (th-1)));
+    m_height_stride = tw * sizeof(T);
+    m_tile_stride = (w + tw-1) / tw * th * m_height_stride;
+    rows = (h + th-1) / th;
+    row_lines = th;
+    row_bytes = m_tile_stride;
+    plane_bytes = m_band_stride = alignBytes(rows * m_tile_stride, m_layout.alignment);
+    bytes = m_layout.left_guard + planes * m_band_stride + m_layout.right_guard;
+  } else {
+    if (m_layout.packing == CPIXMAP_INTERLEAVED) {
+      m_pixel_stride = b * sizeof(T);
+      planes = 1;
+    }
+    m_height_stride = alignBytes(m_layout.left_guard + w * m_pixel_stride + m_layout.right_guard, m_layout.alignment);
+    m_band_stride = planes == 1 && b > 1 ? sizeof(T) : h * m_height_stride;
+    row_bytes = m_height_stride;
+    plane_bytes = h * m_height_stride;
+    bytes = m_layout.left_guard + planes * plane_bytes;
+  }
+
+  cpool::getGlobal().release(m_allocation);
+  m_allocation = (uint8_t *)cpool::getGlobal().allocate(bytes, m_layout.alignment);
+  m_buffer = m_allocation + m_layout.left_guard;
+  switch (init) {
+  case CPIXMAP_UNINITIALIZED:
+    if (m_layout.packing == CPIXMAP_TILED) {
+      memset(m_allocation, 0, m_layout.left_guard);
+      memset(m_buffer + planes * plane_bytes, 0, m_layout.right_guard);
+    } else {
+      clearGuards(w * m_pixel_stride, planes * h);
+    }
+    break;
+  case CPIXMAP_FIRST_TOUCH: touchStrips(h, row_lines, row_bytes, planes, plane_bytes, bytes); break;
+  default: memset(m_allocation, 0, bytes); break;
+  }
+}
+
+/*
+  The bytes from the end of the pixels of a line up to the first pixel of
+  the next line hold the right guard of the one and the left guard of the
+  other, so one memset per line clears all the guards.
+*/
+template <typename T>
+void cpixmap<T>::clearGuards(size_t line_bytes, size_t lines)
+{
+  memset(m_allocation, 0, m_layout.left_guard);
+  for (size_t i = 0; i < lines; ++i)
+    memset(m_buffer + i*m_height_stride + line_bytes, 0, m_height_stride - line_bytes);
+}
+
+/*
+  Clears the rows, of lines or of tiles of row_lines lines, in the strip
+  of the thread, every line with the guards after it; the first and the
+  last strip clear the guards before and after all of them. The strips
+  are those of the height lines of the image (see stripRows), which the
+  kernels split the same way, rounded to the nearest row of tiles.
+*/
+template <typename T>
+void cpixmap<T>::touchStrips(size_t height, size_t row_lines, size_t row_bytes, size_t planes, size_t plane_bytes,
+			     size_t bytes)
+{
+  const size_t rows = (height + row_lines-1) / row_lines;
+
+  if (rows == 0) {
+    memset(m_allocation, 0, bytes);
+    return;
+  }
+#pragma omp parallel
+  {
+    size_t y0, y1;
+    stripRows(height, y0, y1);
+    y0 = y0 == height ? rows : (y0 + row_lines/2) / row_lines;
+    y1 = y1 == height ? rows : (y1 + row_lines/2) / row_lines;
+    if (y0 < y1) {
+      if (y0 == 0) memset(m_allocation, 0, m_layout.left_guard);
+      for (size_t z = 0; z < planes; ++z) {
+	uint8_t *plane = m_buffer + z*plane_bytes;
+	memset(plane + y0*row_bytes, 0, (y1 - y0)*row_bytes);
+	if (y1 == rows) memset(plane + rows*row_bytes, 0, plane_bytes - rows*row_bytes);
+      }
+      if (y1 == rows)
+	memset(m_buffer + planes*plane_bytes, 0, bytes - m_layout.left_guard - planes*plane_bytes);
+    }
+  }
 }
 
 template <typename T>
@@ -156,22 +557,38 @@ inline T *cpixmap<T>::getImage(size_t z) const
   return (T *)(m_buffer + z*m_band_stride);
 }
 
+/*
+  Bytes from the first pixel to pixel (x, y) of band z: within a tiled
+  band, the row of tiles of y, the tile of x in it, then the line and the
+  pixel in that tile.
+*/
+template <typename T>
+inline size_t cpixmap<T>::getPixelOffset(size_t x, size_t y, size_t z) const
+{
+  if (!isTiled()) return z*m_band_stride + y*m_height_stride + x*m_pixel_stride;
+
+  const size_t tw = m_layout.tile_width, th = m_layout.tile_height;
+  return z*m_band_stride + (y / th)*m_tile_stride + (x / tw)*th*m_height_stride +
+    (y & (th-1))*m_height_stride + (x & (tw-1))*sizeof(T);
+}
+
+// a tiled line is contiguous up to the end of its first tile only
 template <typename T>
 inline T *cpixmap<T>::getLine(size_t y, size_t z) const
 {
-  return (T *)(m_buffer + z*m_band_stride + y*m_height_stride);
+  return (T *)(m_buffer + getPixelOffset(0, y, z));
 }
 
 template <typename T>
 inline T& cpixmap<T>::getPixel(size_t x, size_t y, size_t z) const
 {
-  return *(T *)(m_buffer + z*m_band_stride + y*m_height_stride + x*sizeof(T));
+  return *(T *)(m_buffer + getPixelOffset(x, y, z));
 }
 
 template <typename T>
 inline void cpixmap<T>::putPixel(T val, size_t x, size_t y, size_t z)
 {
-  *(T *)(m_buffer + z*m_band_stride + y*m_height_stride + x*sizeof(T)) = val;
+  *(T *)(m_buffer + getPixelOffset(x, y, z)) = val;
 }
 
 template <typename T>
@@ -181,61 +598,95 @@ void cpixmap<T>::readVLine(T *line, size_t len, size_t x, size_t y, size_t z) co
 
   assert(cregion::include(x, y, z));
   
-  p = m_buffer + z*m_band_stride + y*m_height_stride + x*sizeof(T);
+  p = m_buffer + getPixelOffset(x, y, z);
+  if (isTiled()) {
+    // down the lines of a tile, then to the first line of the tile below
+    const size_t th = m_layout.tile_height, jump = m_tile_stride - (th-1)*m_height_stride;
+    for (size_t i = 0; i < std::min(len, m_height-y); ++i) {
+      *(line + i) = *(T *)p;
+      p += ((y + i + 1) & (th-1)) ? m_height_stride : jump;
+    }
+    return;
+  }
   for (size_t i = 0; i < std::min(len, m_height-y); ++i) {
     *(line + i) = *(T *)p;
     p += m_height_stride;
   }
 }
 
+// an interleaved line is deinterleaved on the way, a tiled one gathered from its tiles
 template <typename T>
 void cpixmap<T>::readHLine(T *line, size_t len, size_t x, size_t y, size_t z) const
 {
   uint8_t *p;
+  const size_t n = std::min(len, m_width-x);
 
   assert(cregion::include(x, y, z));
   
-  p = m_buffer + z*m_band_stride + y*m_height_stride + x*sizeof(T);
-  //#pragma omp parallel for
-  for (size_t j = 0; j < std::min(len, m_width-x); ++j) {
-    *(line + j) = *((T *)p + j);
+  if (isTiled()) {
+    const size_t tw = m_layout.tile_width;
+    for (size_t j = 0, run; j < n; j += run) {
+      run = std::min(n - j, tw - ((x + j) & (tw-1)));
+      std::memcpy(line + j, m_buffer + getPixelOffset(x + j, y, z), run * sizeof(T));
+    }
+    return;
   }
+  if (isInterleaved()) {
+    p = m_buffer + y*m_height_stride + x*m_pixel_stride;
+    deinterleaveLine(line, (const T *)p, n, m_bands, z);
+    return;
+  }
+  p = m_buffer + z*m_band_stride + y*m_height_stride + x*sizeof(T);
+  std::memcpy(line, p, n * sizeof(T));
 }
 
-/*
-template <typename T>
-cpixmap<T> cpixmap<T>::operator=(const cpixmap<T>& m)
-{
-  assert(isMatched((cregion)m));
-  
-}
-*/
-
 template <typename T>
 void cpixmap<T>::flipHorizontally(void)
 {
+  if (isTiled()) {
+    for (size_t z = 0; z < m_bands; ++z) {
+#pragma omp parallel for
+      for (size_t y = 0; y < m_height; ++y)
+	for (size_t x = 0; x < (m_width>>1); ++x)
+	  std::swap(getPixel(x, y, z), getPixel((m_width-1) - x, y, z));
+    }
+    return;
+  }
   for (size_t z = 0; z < m_bands; ++z) {
 #pragma omp parallel for
     for (size_t y = 0; y < m_height; ++y) {
       uint8_t *p = m_buffer + z*m_band_stride + y*m_height_stride;
       for (size_t x = 0; x < (m_width>>1); ++x) {
-	T temp = *((T *)p + x);
-	*((T *)p + x) = *((T *)p + (m_width-1) - x);
-	*((T *)p + (m_width-1) - x) = temp;
+	T temp = *(T *)(p + x*m_pixel_stride);
+	*(T *)(p + x*m_pixel_stride) = *(T *)(p + ((m_width-1) - x)*m_pixel_stride);
+	*(T *)(p + ((m_width-1) - x)*m_pixel_stride) = temp;
       }
     }
   }
 }
 
+// a tiled band swaps its lines a tile wide at a time, instead of walking columns
 template <typename T>
 void cpixmap<T>::flipVertically(void)
 {
+  if (isTiled()) {
+    const size_t tw = m_layout.tile_width;
+    for (size_t z = 0; z < m_bands; ++z) {
+#pragma omp parallel for
+      for (size_t y = 0; y < (m_height>>1); ++y)
+	for (size_t x = 0; x < m_width; x += tw) {
+	  T *a = (T *)(m_buffer + getPixelOffset(x, y, z));
+	  std::swap_ranges(a, a + std::min(tw, m_width - x), (T *)(m_buffer + getPixelOffset(x, (m_height-1) - y, z)));
+	}
+    }
+    return;
+  }
   for (size_t z = 0; z < m_bands; ++z) {
 #pragma omp parallel for
     for (size_t x = 0; x < m_width; ++x) {
-      uint8_t *p = m_buffer + z*m_band_stride + x*sizeof(T);
+      uint8_t *p = m_buffer + z*m_band_stride + x*m_pixel_stride;
       for (size_t y = 0; y < (m_height>>1); ++y) {
-	T temp = *((T *)p + y*m_height_stride);
+	T temp = *(T *)(p + y*m_height_stride);
 	*(T *)(p + y*m_height_stride) = *(T *)(p + ((m_height-1) - y)*m_height_stride);
 	*(T *)(p + ((m_height-1)-y)*m_height_stride) = temp;
       }
@@ -249,8 +700,12 @@ void cpixmap<T>::lshiftPixel(size_t bits)
   for (size_t z = 0; z < m_bands; ++z) {
 #pragma omp parallel for
     for (size_t y = 0; y < m_height; ++y) {
-      T *p = (T *)(m_buffer + z*m_band_stride + y*m_height_stride);
-      for (size_t x = 0; x < m_width; ++x) *p++ <<= bits;
+      if (isTiled()) {
+	for (size_t x = 0; x < m_width; ++x) getPixel(x, y, z) <<= bits;
+	continue;
+      }
+      uint8_t *p = m_buffer + z*m_band_stride + y*m_height_stride;
+      for (size_t x = 0; x < m_width; ++x) *(T *)(p + x*m_pixel_stride) <<= bits;
     }
   }
 }
@@ -261,8 +716,54 @@ void cpixmap<T>::rshiftPixel(size_t bits)
   for (size_t z = 0; z < m_bands; ++z) {
 #pragma omp parallel for
     for (size_t y = 0; y < m_height; ++y) {
-      T *p = (T *)(m_buffer + z*m_band_stride + y*m_height_stride);
-      for (size_t x = 0; x < m_width; ++x) *p++ >>= bits;
+      if (isTiled()) {
+	for (size_t x = 0; x < m_width; ++x) getPixel(x, y, z) >>= bits;
+	continue;
+      }
+      uint8_t *p = m_buffer + z*m_band_stride + y*m_height_stride;
+      for (size_t x = 0; x < m_width; ++x) *(T *)(p + x*m_pixel_stride) >>= bits;
     }
   }
 }
+
+/*
+  Region of interest of a cpixmap, without a copy: the origin of the
+  cregion is the position of the view in its parent, and the lines are
+  those of the parent, so the pixels around the view stay readable
+  through getParent(). The parent must outlive the view.
+*/
+template <typename T>
+class cpixmap_view : public cregion<size_t> {
+public:
+  cpixmap_view(const cpixmap<T>& parent, const cregion& roi);
+  cpixmap_view(const cpixmap<T>& parent, size_t x, size_t y, size_t w, size_t h);
+  const cpixmap<T>& getParent(void) const { return *m_parent; }
+  T *getLine(size_t y, size_t z = 0) const
+  {
+    assert(!m_parent->isTiled());
+    return (T *)((uint8_t *)m_parent->getLine(m_y + y, m_z + z) + m_x * m_parent->getPixelStride());
+  }
+  T& getPixel(size_t x, size_t y, size_t z = 0) const { return m_parent->getPixel(m_x + x, m_y + y, m_z + z); }
+  size_t getLineStride(void) const { return m_parent->getLineStride(); }
+  size_t getPixelStride(void) const { return m_parent->getPixelStride(); }
+  bool isInterleaved(void) const { return m_parent->isInterleaved(); }
+  bool isTiled(void) const { return m_parent->isTiled(); }
+  bool isLinear(void) const { return m_parent->isLinear(); }
+private:
+  const cpixmap<T> *m_parent;
+};
+
+template <typename T>
+cpixmap_view<T>::cpixmap_view(const cpixmap<T>& parent, const cregion& roi)
+  : cregion(roi), m_parent(&parent)
+{
+  assert(getXEnd() <= parent.getWidth() && getYEnd() <= parent.getHeight() && getZEnd() <= parent.getBands());
+}
+
+// all the bands of the parent
+template <typename T>
+cpixmap_view<T>::cpixmap_view(const cpixmap<T>& parent, size_t x, size_t y, size_t w, size_t h)
+  : cregion(x, y, 0, w, h, parent.getBands()), m_parent(&parent)
+{
+  assert(getXEnd() <= parent.getWidth() && getYEnd() <= parent.getHeight());
+}
@@ -0,0 +1,147 @@
+/*
+  Copyright (C) 2017 Hoyoung Lee
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  dTLB load misses and throughput of flipVertically() and of the Sobel
+  kernel on a large pixmap, with 4 KiB pages and with huge pages (see
+  CPOOL_HUGE_PAGE_THRESHOLD), e.g.
+
+  g++ -O3 -I. -mavx2 -mfma -fopenmp -DUSE_SIMD cpixmap.hugepage.bench.cpp -o cpixmap.hugepage.bench
+  ./cpixmap.hugepage.bench [width height frames]
+
+  The misses come from perf_event_open(), so they read n/a where
+  /proc/sys/kernel/perf_event_paranoid does not allow it; AnonHugePages
+  tells how much of the process the kernel did back with huge pages.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "sobel.hpp"
+
+/*
+  Counts the dTLB load misses of the calling thread and of the threads it
+  creates afterwards, -1 when not allowed. It must be opened before the
+  first parallel region, so that the OpenMP workers inherit it.
+*/
+class tlb_counter {
+public:
+  tlb_counter(void)
+  {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    m_fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+  virtual ~tlb_counter(void) { if (m_fd >= 0) close(m_fd); }
+  void start(void)
+  {
+    if (m_fd < 0) return;
+    ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+  long long stop(void)
+  {
+    long long count = -1;
+    if (m_fd < 0) return -1;
+    ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+    if (read(m_fd, &count, sizeof(count)) != sizeof(count)) return -1;
+    return count;
+  }
+private:
+  int m_fd;
+};
+
+static long anonHugePagesKiB(void)
+{
+  long total = 0, kib;
+  char line[256];
+  FILE *fp = fopen("/proc/self/smaps", "r");
+  if (!fp) return -1;
+  while (fgets(line, sizeof(line), fp))
+    if (sscanf(line, "AnonHugePages: %ld kB", &kib) == 1) total += kib;
+  fclose(fp);
+  return total;
+}
+
+static void printResult(const char *title, double ms, long long misses, size_t pixels)
+{
+  if (misses < 0)
+    printf("  %-16s %9.3f ms %8.1f Mpixel/s  dTLB misses n/a\n", title, ms, pixels / ms / 1e3);
+  else
+    printf("  %-16s %9.3f ms %8.1f Mpixel/s  dTLB misses %12lld (%.2f per Kpixel)\n",
+	   title, ms, pixels / ms / 1e3, misses, misses * 1e3 / pixels);
+}
+
+static void bench(tlb_counter& tlb, const char *title, size_t threshold, size_t width, size_t height, int frames)
+{
+  cpool::getGlobal().trim();
+  cpool::getGlobal().setHugePageThreshold(threshold);
+
+  cpixmap<uint8_t> gray(width, height, 1, CPIXMAP_FIRST_TOUCH);
+  cpixmap<int16_t> dx(width, height, 1, CPIXMAP_FIRST_TOUCH), dy(width, height, 1, CPIXMAP_FIRST_TOUCH);
+  srand(1);
+  for (size_t y = 0; y < height; ++y) {
+    uint8_t *line = gray.getLine(y);
+    for (size_t x = 0; x < width; ++x) line[x] = (uint8_t)rand();
+  }
+  printf("%s, AnonHugePages %ld KiB\n", title, anonHugePagesKiB());
+
+  std::chrono::steady_clock::time_point start;
+  std::chrono::duration<double, std::milli> elapsed;
+
+  start = std::chrono::steady_clock::now();
+  tlb.start();
+  for (int i = 0; i < frames; ++i) gray.flipVertically();
+  long long misses = tlb.stop();
+  elapsed = std::chrono::steady_clock::now() - start;
+  printResult("flipVertically", elapsed.count() / frames, misses / (misses < 0 ? 1 : frames), width*height);
+
+  start = std::chrono::steady_clock::now();
+  tlb.start();
+  for (int i = 0; i < frames; ++i) edgeSobelKernel(gray, dx, dy);
+  misses = tlb.stop();
+  elapsed = std::chrono::steady_clock::now() - start;
+  printResult("edgeSobelKernel", elapsed.count() / frames, misses / (misses < 0 ? 1 : frames), width*height);
+}
+
+int main(int argc, char *argv[])
+{
+  size_t width = argc > 2 ? atol(argv[1]) : 16384;
+  size_t height = argc > 2 ? atol(argv[2]) : 16384;
+  int frames = argc > 3 ? atoi(argv[3]) : 3;
+
+  tlb_counter tlb;
+
+  printf("%zux%zu uint8 -> int16, %d frames\n", width, height, frames);
+  bench(tlb, "4 KiB pages", (size_t)-1, width, height, frames);
+  bench(tlb, "huge pages", CPOOL_HUGE_PAGE_THRESHOLD, width, height, frames);
+  return 0;
+}
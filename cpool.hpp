@@ -0,0 +1,301 @@
+/*
+  Copyright (C) 2017 Hoyoung Lee
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <cstring>
+#include <cstdint>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#ifdef __linux__
+# include <sys/mman.h>
+#endif
+
+/*
+  Idle bytes a cpool keeps at most; buffers released beyond it are freed.
+  0 turns the pooling off.
+*/
+#ifndef CPOOL_BYTES_LIMIT
+# define CPOOL_BYTES_LIMIT ((size_t)1 << 30)
+#endif
+
+/*
+  Buffers of at least CPOOL_HUGE_PAGE_THRESHOLD bytes are mapped on huge
+  pages (see hugePagesMap), so that the thousands of 4 KiB pages of a
+  large pixmap take a few TLB entries. (size_t)-1 turns it off.
+*/
+#ifndef CPOOL_HUGE_PAGE_THRESHOLD
+# define CPOOL_HUGE_PAGE_THRESHOLD ((size_t)4 << 20)
+#endif
+#define CPOOL_HUGE_PAGE_BYTES ((size_t)2 << 20)
+
+static inline size_t alignBytes(size_t bytes, size_t alignment)
+{
+  return (bytes + alignment - 1) & ~(alignment - 1);
+}
+
+/*
+  Kept just before every aligned block: the pointer new[] or mmap()
+  returned and the length mapped (0 for new[]), for alignedFree(), and
+  the size and the alignment of the block, for cpool.
+*/
+struct aligned_header {
+  uint8_t *raw;
+  size_t mapped;
+  size_t bytes;
+  size_t alignment;
+};
+
+/*
+  length bytes, a multiple of CPOOL_HUGE_PAGE_BYTES, on huge pages: from
+  the hugetlbfs pool with MAP_HUGETLB when it has pages reserved, else as
+  a mapping aligned to the huge page size and advised to the transparent
+  huge pages. NULL when no huge page mapping is possible.
+*/
+static inline uint8_t *hugePagesMap(size_t length)
+{
+#ifdef __linux__
+  void *p;
+# ifdef MAP_HUGETLB
+  p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (p != MAP_FAILED) return (uint8_t *)p;
+# endif
+# ifdef MADV_HUGEPAGE
+  size_t span = length + CPOOL_HUGE_PAGE_BYTES;
+  p = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) return NULL;
+
+  uint8_t *q = (uint8_t *)p, *a = (uint8_t *)alignBytes((uintptr_t)q, CPOOL_HUGE_PAGE_BYTES);
+  if (a > q) munmap(q, a - q);
+  if (q + span > a + length) munmap(a + length, q + span - (a + length));
+  madvise(a, length, MADV_HUGEPAGE);
+  return a;
+# endif
+#endif
+  (void)length;
+  return NULL;
+}
+
+/*
+  bytes of memory aligned to alignment, a power of two, on huge pages
+  when huge is set and the system has them.
+*/
+static inline void *alignedAllocate(size_t bytes, size_t alignment, bool huge = false)
+{
+  aligned_header header;
+  const size_t total = bytes + alignment + sizeof(aligned_header);
+  header.raw = NULL;
+  header.mapped = 0;
+  if (huge) {
+    header.mapped = alignBytes(total, CPOOL_HUGE_PAGE_BYTES);
+    header.raw = hugePagesMap(header.mapped);
+    if (!header.raw) header.mapped = 0;
+  }
+  if (!header.raw) header.raw = new uint8_t[total];
+  header.bytes = bytes;
+  header.alignment = alignment;
+  uint8_t *p = (uint8_t *)alignBytes((uintptr_t)(header.raw + sizeof(aligned_header)), alignment);
+  std::memcpy(p - sizeof(aligned_header), &header, sizeof(aligned_header));
+  return p;
+}
+
+static inline aligned_header alignedHeader(const void *p)
+{
+  aligned_header header;
+  std::memcpy(&header, (const uint8_t *)p - sizeof(aligned_header), sizeof(aligned_header));
+  return header;
+}
+
+static inline void alignedFree(void *p)
+{
+  if (!p) return;
+  const aligned_header header = alignedHeader(p);
+#ifdef __linux__
+  if (header.mapped) {
+    munmap(header.raw, header.mapped);
+    return;
+  }
+#endif
+  delete [] header.raw;
+}
+
+/*
+  Aligned buffers for cpixmap, cchunk and the line rings of the kernels,
+  keyed by size and alignment. A released buffer goes to the free list of
+  its key, threaded through the idle buffers themselves, and the next
+  allocation of that key takes it back, so a loop over frames of one
+  geometry stops allocating after its first frame. Only a key seen for the
+  first time grows the list of keys.
+
+  The counters: hits are allocations served from the pool, misses those
+  that went to new[] or mmap(), and the bytes held are those of the idle
+  buffers. A miss of getHugePageThreshold() bytes or more asks for huge
+  pages.
+*/
+class cpool {
+public:
+  cpool(size_t limit = CPOOL_BYTES_LIMIT)
+    : m_limit(limit), m_huge_threshold(CPOOL_HUGE_PAGE_THRESHOLD), m_hits(0), m_misses(0), m_bytes_held(0) {}
+  virtual ~cpool(void) { trim(); }
+  void *allocate(size_t bytes, size_t alignment);
+  void release(void *p);
+  void trim(void);
+  void setBytesLimit(size_t limit);
+  size_t getBytesLimit(void) const;
+  void setHugePageThreshold(size_t bytes);
+  size_t getHugePageThreshold(void) const;
+  size_t getHits(void) const;
+  size_t getMisses(void) const;
+  size_t getBytesHeld(void) const;
+  void resetCounters(void);
+  static cpool& getGlobal(void);
+private:
+  struct free_list {
+    size_t bytes;
+    size_t alignment;
+    void *head;
+  };
+  void freeIdle(size_t limit);
+  std::vector<free_list> m_lists;
+  size_t m_limit;
+  size_t m_huge_threshold;
+  size_t m_hits;
+  size_t m_misses;
+  size_t m_bytes_held;
+  mutable std::mutex m_mutex;
+};
+
+inline void *cpool::allocate(size_t bytes, size_t alignment)
+{
+  // an idle buffer holds the link to the next one
+  bytes = std::max(bytes, sizeof(void *));
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (size_t i = 0; i < m_lists.size(); ++i) {
+    free_list& list = m_lists[i];
+    if (list.bytes != bytes || list.alignment != alignment) continue;
+    if (!list.head) break;
+    void *p = list.head;
+    std::memcpy(&list.head, p, sizeof(void *));
+    m_bytes_held -= bytes;
+    ++m_hits;
+    return p;
+  }
+  ++m_misses;
+  return alignedAllocate(bytes, alignment, bytes >= m_huge_threshold);
+}
+
+inline void cpool::release(void *p)
+{
+  if (!p) return;
+  const aligned_header header = alignedHeader(p);
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_bytes_held + header.bytes > m_limit) {
+    alignedFree(p);
+    return;
+  }
+  size_t i = 0;
+  while (i < m_lists.size() && (m_lists[i].bytes != header.bytes || m_lists[i].alignment != header.alignment)) ++i;
+  if (i == m_lists.size()) {
+    free_list list = { header.bytes, header.alignment, NULL };
+    m_lists.push_back(list);
+  }
+  std::memcpy(p, &m_lists[i].head, sizeof(void *));
+  m_lists[i].head = p;
+  m_bytes_held += header.bytes;
+}
+
+// frees every idle buffer
+inline void cpool::trim(void)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  freeIdle(0);
+}
+
+inline void cpool::setBytesLimit(size_t limit)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_limit = limit;
+  freeIdle(limit);
+}
+
+inline size_t cpool::getBytesLimit(void) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_limit;
+}
+
+inline void cpool::setHugePageThreshold(size_t bytes)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_huge_threshold = bytes;
+}
+
+inline size_t cpool::getHugePageThreshold(void) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_huge_threshold;
+}
+
+inline size_t cpool::getHits(void) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_hits;
+}
+
+inline size_t cpool::getMisses(void) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_misses;
+}
+
+inline size_t cpool::getBytesHeld(void) const
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  return m_bytes_held;
+}
+
+inline void cpool::resetCounters(void)
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_hits = m_misses = 0;
+}
+
+/*
+  The pool of cpixmap and cchunk. It is never destroyed, so that static
+  pixmaps can release their buffers at exit in any order.
+*/
+inline cpool& cpool::getGlobal(void)
+{
+  static cpool *pool = new cpool;
+  return *pool;
+}
+
+// with m_mutex held
+inline void cpool::freeIdle(size_t limit)
+{
+  for (size_t i = 0; i < m_lists.size() && m_bytes_held > limit; ++i) {
+    free_list& list = m_lists[i];
+    while (list.head && m_bytes_held > limit) {
+      void *p = list.head;
+      std::memcpy(&list.head, p, sizeof(void *));
+      m_bytes_held -= list.bytes;
+      alignedFree(p);
+    }
+  }
+}
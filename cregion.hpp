@@ -119,7 +119,7 @@ public:
   cregion(T x, T y, T w, T h)
     : m_x(x), m_y(y), m_z(0), m_width(w), m_height(h), m_bands(1) {}
   cregion(T x, T y, T z, T w, T h, T b = 1)
-    : m_width(w), m_height(h), m_bands(b), m_x(x), m_y(y), m_z(z) {}
+    : m_x(x), m_y(y), m_z(z), m_width(w), m_height(h), m_bands(b) {}
   virtual ~cregion() { }
   virtual void setResolution(T w, T h, T b = 1);
   T getWidth(void) const;
@@ -136,6 +136,7 @@ public:
   bool include(const T x, const T y, const T z = 0) const;
   bool include(const cpoint<T>& pt) const;
   virtual bool isMatched(const cregion& dim) const;
+  bool isResolutionMatched(const cregion& dim) const;
   int getLeftHalf(void) const;
   int getRightHalf(void) const;
   int getUpHalf(void) const;
@@ -171,6 +172,13 @@ inline bool cregion<T>::isMatched(const cregion& dim) const
     m_z == dim.m_z && m_bands == dim.m_bands;
 }
 
+// same width, height and bands, wherever the origins are
+template <typename T>
+inline bool cregion<T>::isResolutionMatched(const cregion& dim) const
+{
+  return m_width == dim.m_width && m_height == dim.m_height && m_bands == dim.m_bands;
+}
+
 template <typename T>
 inline void cregion<T>::setResolution(T w, T h, T b)
 {
@@ -20,8 +20,22 @@
 #include <iostream>
 #include <cstring>
 #include <cstdint>
+#include <algorithm>
 
 #include <cpixmap.hpp>
+#include <sobel.types.hpp>
+#include <stencil.hpp>
+
+/*
+  Each kernel is split into a line kernel, which computes one output line
+  from the prev/curr/next lines of a window3x3_frame, and an image kernel,
+  which walks the frame with sobel3x3Frame() from sobel.hpp. The stencil
+  line kernels are the engine of stencil.hpp over the lane policies below.
+
+  When SOBEL_NAMESPACE is defined only the line kernels are compiled, and
+  they are put into that namespace. sobel.dispatch.cpp uses this to build
+  one copy of them per instruction set.
+*/
 
 #if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
 # define MAX_VECTOR_SIZE 512
@@ -35,597 +49,919 @@
 # error "Undefined SIMD!"
 #endif
 
-inline void edgeHSobelKernel(cpixmap<uint8_t>& gray, cpixmap<int8_t>& dx)
+#ifdef SOBEL_NAMESPACE
+namespace SOBEL_NAMESPACE {
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && INSTRSET >= 9 && defined(__AVX512BW__)
+/*
+  vectorclass 1.27 has no 8- and 16-bit integer vectors for AVX-512, so
+  this is the small part of Vec64uc/Vec32us that the kernels below need.
+  load_partial/store_partial are masked, so they never touch memory past
+  the n-th element.
+*/
+static inline __mmask64 partial_mask64(int n)
 {
-  assert(gray.isMatched(dx));
+  return n >= 64 ? ~(__mmask64)0 : (((__mmask64)1 << n) - 1);
+}
 
-  for (size_t z  = 0; z < gray.getBands(); ++z) {
-    window3x3_frame<uint8_t> gray3x3(gray);
-    gray3x3.draftFrame(gray, z);
+class Vec64c {
+public:
+  Vec64c(void) {}
+  Vec64c(__m512i const& x) : zmm(x) {}
+  operator __m512i() const { return zmm; }
+  Vec64c& load(void const *p) { zmm = _mm512_loadu_si512(p); return *this; }
+  Vec64c& load_partial(int n, void const *p)
+  {
+    zmm = _mm512_maskz_loadu_epi8(partial_mask64(n), p);
+    return *this;
+  }
+  void store(void *p) const { _mm512_storeu_si512(p, zmm); }
+  void store_partial(int n, void *p) const { _mm512_mask_storeu_epi8(p, partial_mask64(n), zmm); }
+protected:
+  __m512i zmm;
+};
+
+class Vec64uc : public Vec64c {
+public:
+  Vec64uc(void) {}
+  Vec64uc(__m512i const& x) : Vec64c(x) {}
+};
+
+static inline Vec64uc operator+(Vec64uc const& a, Vec64uc const& b) { return _mm512_add_epi8(a, b); }
+static inline Vec64uc operator-(Vec64uc const& a, Vec64uc const& b) { return _mm512_sub_epi8(a, b); }
+static inline Vec64uc operator-(Vec64uc const& a) { return _mm512_sub_epi8(_mm512_setzero_si512(), a); }
+static inline Vec64uc operator>>(Vec64uc const& a, int b)
+{
+  // no 8-bit shift in AVX512BW: shift 16-bit lanes and clear the bits from the upper byte
+  return _mm512_and_si512(_mm512_srl_epi16(a, _mm_cvtsi32_si128(b)), _mm512_set1_epi8((char)(0xff >> b)));
+}
+static inline Vec64uc operator<<(Vec64uc const& a, int b)
+{
+  // and the bits from the lower byte
+  return _mm512_and_si512(_mm512_sll_epi16(a, _mm_cvtsi32_si128(b)), _mm512_set1_epi8((char)(0xff << b)));
+}
 
-    for (size_t y = 0; y < gray.getHeight(); ++y) {
-      int8_t *dxLine = dx.getLine(y, z);
-      uint8_t *prevLine = gray3x3.getPrevLine();
-      uint8_t *currLine = gray3x3.getCurrLine();
-      uint8_t *nextLine = gray3x3.getNextLine();
+class Vec32s {
+public:
+  Vec32s(void) {}
+  Vec32s(__m512i const& x) : zmm(x) {}
+  operator __m512i() const { return zmm; }
+  Vec32s& load(void const *p) { zmm = _mm512_loadu_si512(p); return *this; }
+  Vec32s& load_partial(int n, void const *p)
+  {
+    zmm = _mm512_maskz_loadu_epi16((__mmask32)partial_mask64(n), p);
+    return *this;
+  }
+  void store(void *p) const { _mm512_storeu_si512(p, zmm); }
+  void store_partial(int n, void *p) const { _mm512_mask_storeu_epi16(p, (__mmask32)partial_mask64(n), zmm); }
+protected:
+  __m512i zmm;
+};
+
+static inline Vec32s operator+(Vec32s const& a, Vec32s const& b) { return _mm512_add_epi16(a, b); }
+static inline Vec32s operator-(Vec32s const& a, Vec32s const& b) { return _mm512_sub_epi16(a, b); }
+static inline Vec32s operator<<(Vec32s const& a, int b) { return _mm512_sll_epi16(a, _mm_cvtsi32_si128(b)); }
+static inline Vec32s operator>>(Vec32s const& a, int b) { return _mm512_sra_epi16(a, _mm_cvtsi32_si128(b)); }
+
+class Vec32us : public Vec32s {
+public:
+  Vec32us(void) {}
+  Vec32us(__m512i const& x) : Vec32s(x) {}
+};
+
+static inline Vec32us operator+(Vec32us const& a, Vec32us const& b) { return _mm512_add_epi16(a, b); }
+static inline Vec32us operator-(Vec32us const& a, Vec32us const& b) { return _mm512_sub_epi16(a, b); }
+static inline Vec32us operator-(Vec32us const& a) { return _mm512_sub_epi16(_mm512_setzero_si512(), a); }
+static inline Vec32us operator>>(Vec32us const& a, int b) { return _mm512_srl_epi16(a, _mm_cvtsi32_si128(b)); }
+static inline Vec32us operator<<(Vec32us const& a, int b) { return _mm512_sll_epi16(a, _mm_cvtsi32_si128(b)); }
+#endif
 
-      /*
-      nwVec|nnVec|neVec
-      -----+-----+-----
-      wwVec|ooVec|eeVec
-      -----+-----+-----
-      swVec|ssVec|seVec
-      */
-#pragma omp parallel for
+/*
+  Lane policies of the stencil engine (see stencil.hpp), for the
+  instruction set at hand:
+
+  sobel_keep8/sobel_keep16 load the pixels into lanes of their own width,
+  for the lossy taps, whose sums wrap into int8/int16.
+  sobel_widen8/sobel_widen16 zero-extend them into lanes twice as wide,
+  uint8 -> int16 and uint16 -> int32, for the exact taps, so no low bits
+  are shifted out and nothing overflows. A vector holds half the pixels,
+  so they run well below the lossy lanes, see sobel.bench.cpp.
+  sobel_widen8x32 zero-extends uint8 into 32-bit lanes, for the magnitude
+  and orientation kernels, together with the store_narrow() overloads.
+  sobel_signed16/sobel_signed16x32/sobel_signed32 load the column sums of
+  the separable engine, int16 -> int16, int16 -> int32 and int32 -> int32,
+  for the row sums of the 5x5 and 7x7 kernels.
+  sobel_float32/sobel_float64 keep float/double pixels as they are, and
+  multiply-add the exact taps (FMA when the instruction set has it).
+*/
 #if defined(__x86_64__) || defined(__i386__)
-# if INSTRSET >= 8 // AVXx - 256bits
-      for (size_t x = 0; x < gray.getWidth(); x += 32) {
-	Vec32uc nwVec, /*nnVec,*/ neVec;
-	nwVec.load(&prevLine[(int)x-1]), /*nnVec.load(&prevLine[(int)x+0]),*/ neVec.load(&prevLine[(int)x+1]);
-	Vec32uc wwVec, eeVec;
-	wwVec.load(&currLine[(int)x-1]), eeVec.load(&currLine[(int)x+0]);
-	Vec32uc swVec, /*ssVec,*/ seVec;
-	swVec.load(&nextLine[(int)x-1]), /*ssVec.load(&nextLine[(int)x+0]),*/ seVec.load(&nextLine[(int)x+1]);
-	Vec32c dxVec =
-	  -(nwVec>>3) + (neVec>>3)
-	  -(wwVec>>2) + (eeVec>>2)
-	  -(swVec>>3) + (seVec>>3);
-	dxVec.store(&dxLine[x]);
-      }
-# elif INSTRSET >= 2 // SSE2 - 128bits
-      for (size_t x = 0; x < gray.getWidth(); x += 16) {
-	Vec16uc nwVec, /*nnVec,*/ neVec;
-	nwVec.load(&prevLine[(int)x-1]), /*nnVec.load(&prevLine[(int)x+0]),*/ neVec.load(&prevLine[(int)x+1]);
-	Vec16uc wwVec, eeVec;
-	wwVec.load(&currLine[(int)x-1]), eeVec.load(&currLine[(int)x+0]);
-	Vec16uc swVec, /*ssVec,*/ seVec;
-	swVec.load(&nextLine[(int)x-1]), /*ssVec.load(&nextLine[(int)x+0]),*/ seVec.load(&nextLine[(int)x+1]);
-	Vec16c dxVec =
-	  -(nwVec>>3) + (neVec>>3)
-	  -(wwVec>>2) + (eeVec>>2)
-	  -(swVec>>3) + (seVec>>3);
-	dxVec.store(&dxLine[x]);
-      }
-# endif
-#elif defined(__ARM_NEON__)
-      for (size_t x = 0; x < gray.getWidth(); x += 16) {
-	uint8x16_t nwVec, /*nnVec,*/ neVec;
-	nwVec = vld1q_u8((const uint8_t *)&prevLine[(int)x-1]);
-	//nnVec = vld1q_u8((const uint8_t *)&prevLine[(int)x+0]);
-	neVec = vld1q_u8((const uint8_t *)&prevLine[(int)x+1]);
-	uint8x16_t wwVec, eeVec;
-	wwVec = vld1q_u8((const uint8_t *)&currLine[(int)x-1]);
-	eeVec = vld1q_u8((const uint8_t *)&currLine[(int)x+1]);
-	uint8x16_t swVec, /*ssVec,*/ seVec;
-	swVec = vld1q_u8((const uint8_t *)&nextLine[(int)x-1]);
-	//ssVec = vld1q_u8((const uint8_t *)&nextLine[(int)x+0]);
-	seVec = vld1q_u8((const uint8_t *)&nextLine[(int)x+1]);
-	
-	int8x16_t lsumVec, rsumVec;
-	uint8x16_t tempVec;
-	tempVec = vdupq_n_u8((uint8_t)0);
-	tempVec = vsra_n_u8(tempVec, nwVec, 3);
-	tempVec = vsra_n_u8(tempVec, wwVec, 2);
-	tempVec = vsra_n_u8(tempVec, swVec, 3);
-	lsumVec = vreinterpretq_s8_u8(tempVec);
-	
-	tempVec = vdupq_n_u8((uint8_t)0);
-	tempVec = vsra_n_u8(tempVec, neVec, 3);
-	tempVec = vsra_n_u8(tempVec, eeVec, 2);
-	tempVec = vsra_n_u8(tempVec, seVec, 3);
-	rsumVec = vreinterpretq_s8_u8(tempVec);
-	
-	int8x16_t dxVec = vsubq_s8(rsum, lsum);
-	vst1q_s8((int8_t *)&dxLine[x], dxVec);
-      }
-#endif
-      gray3x3.shiftFrame(gray, z);
-    }
+# if INSTRSET >= 9 && defined(__AVX512BW__) // AVX512BW - 512bits
+// vectors one pixel of E bytes to the left/right, for the separable engine
+template <int E>
+static inline __m512i lanes_prev(__m512i prev, __m512i v)
+{
+  return _mm512_alignr_epi8(v, _mm512_alignr_epi64(v, prev, 6), 16 - E);
+}
+template <int E>
+static inline __m512i lanes_next(__m512i v, __m512i next)
+{
+  return _mm512_alignr_epi8(_mm512_alignr_epi64(next, v, 2), v, E);
+}
+
+struct sobel_keep8 {
+  typedef Vec64uc vec;
+  enum { lanes = 64 };
+  static vec zero(void) { return _mm512_setzero_si512(); }
+  static vec prevLanes(const vec& prev, const vec& v) { return lanes_prev<1>(prev, v); }
+  static vec nextLanes(const vec& v, const vec& next) { return lanes_next<1>(v, next); }
+  static vec load(const uint8_t *p, int n) { vec v; v.load_partial(n, p); return v; }
+  static void store(const vec& v, int8_t *p, int n) { v.store_partial(n, p); }
+};
+
+struct sobel_keep16 {
+  typedef Vec32us vec;
+  enum { lanes = 32 };
+  static vec zero(void) { return _mm512_setzero_si512(); }
+  static vec prevLanes(const vec& prev, const vec& v) { return lanes_prev<2>(prev, v); }
+  static vec nextLanes(const vec& v, const vec& next) { return lanes_next<2>(v, next); }
+  static vec load(const uint16_t *p, int n) { vec v; v.load_partial(n, p); return v; }
+  static void store(const vec& v, int16_t *p, int n) { v.store_partial(n, p); }
+};
+
+struct sobel_widen8 {
+  typedef Vec32s vec;
+  enum { lanes = 32 };
+  static vec zero(void) { return _mm512_setzero_si512(); }
+  static vec prevLanes(const vec& prev, const vec& v) { return lanes_prev<2>(prev, v); }
+  static vec nextLanes(const vec& v, const vec& next) { return lanes_next<2>(v, next); }
+  static vec load(const uint8_t *p, int n)
+  {
+    return _mm512_cvtepu8_epi16(_mm512_castsi512_si256(_mm512_maskz_loadu_epi8(partial_mask64(n), p)));
+  }
+  static void store(const vec& v, int16_t *p, int n) { v.store_partial(n, p); }
+};
+
+struct sobel_widen16 {
+  typedef Vec16i vec;
+  enum { lanes = 16 };
+  static vec zero(void) { return _mm512_setzero_si512(); }
+  static vec load(const uint16_t *p, int n)
+  {
+    return _mm512_cvtepu16_epi32(_mm512_castsi512_si256(_mm512_maskz_loadu_epi16((__mmask32)partial_mask64(n), p)));
+  }
+  static void store(const vec& v, int32_t *p, int n) { v.store_partial(n, p); }
+};
+
+struct sobel_widen8x32 {
+  typedef Vec16i vec;
+  enum { lanes = 16 };
+  static vec zero(void) { return _mm512_setzero_si512(); }
+  static vec load(const uint8_t *p, int n)
+  {
+    return _mm512_cvtepu8_epi32(_mm512_castsi512_si128(_mm512_maskz_loadu_epi8(partial_mask64(n), p)));
+  }
+};
+
+struct sobel_signed16 {
+  typedef Vec32s vec;
+  enum { lanes = 32 };
+  static vec zero(void) { return _mm512_setzero_si512(); }
+  static vec load(const int16_t *p, int n) { vec v; v.load_partial(n, p); return v; }
+  static void store(const vec& v, int16_t *p, int n) { v.store_partial(n, p); }
+};
+
+struct sobel_signed16x32 {
+  typedef Vec16i vec;
+  enum { lanes = 16 };
+  static vec zero(void) { return _mm512_setzero_si512(); }
+  static vec load(const int16_t *p, int n)
+  {
+    return _mm512_cvtepi16_epi32(_mm512_castsi512_si256(_mm512_maskz_loadu_epi16((__mmask32)partial_mask64(n), p)));
   }
+  static void store(const vec& v, int32_t *p, int n) { v.store_partial(n, p); }
+};
+
+struct sobel_signed32 {
+  typedef Vec16i vec;
+  enum { lanes = 16 };
+  static vec zero(void) { return _mm512_setzero_si512(); }
+  static vec load(const int32_t *p, int n) { vec v; v.load_partial(n, p); return v; }
+  static void store(const vec& v, int32_t *p, int n) { v.store_partial(n, p); }
+};
+
+struct sobel_float32 {
+  typedef Vec16f vec;
+  enum { lanes = 16 };
+  static vec zero(void) { return _mm512_setzero_ps(); }
+  static vec mulAdd(const vec& p, int weight, const vec& sum) { return mul_add(p, vec((float)weight), sum); }
+  static vec load(const float *p, int n) { vec v; v.load_partial(n, p); return v; }
+  static void store(const vec& v, float *p, int n) { v.store_partial(n, p); }
+};
+
+struct sobel_float64 {
+  typedef Vec8d vec;
+  enum { lanes = 8 };
+  static vec zero(void) { return _mm512_setzero_pd(); }
+  static vec mulAdd(const vec& p, int weight, const vec& sum) { return mul_add(p, vec((double)weight), sum); }
+  static vec load(const double *p, int n) { vec v; v.load_partial(n, p); return v; }
+  static void store(const vec& v, double *p, int n) { v.store_partial(n, p); }
+};
+
+static inline void store_narrow(const Vec16i& v, uint32_t *p, int n) { v.store_partial(n, p); }
+static inline void store_narrow(const Vec16i& v, uint16_t *p, int n)
+{
+  _mm512_mask_cvtepi32_storeu_epi16(p, (__mmask16)partial_mask64(n), v);
+}
+static inline void store_narrow(const Vec16i& v, uint8_t *p, int n)
+{
+  _mm512_mask_cvtepi32_storeu_epi8(p, (__mmask16)partial_mask64(n), v);
 }
 
-inline void edgeVSobelKernel(cpixmap<uint8_t>& gray, cpixmap<int8_t>& dy)
+// the L2 norm of 16-bit input, see sobelNormL2()
+static inline Vec16i sobelNormL2(const Vec16i& dx, const Vec16i& dy, uint32_t)
+{
+  Vec8d xl = to_double(dx.get_low()), xh = to_double(dx.get_high());
+  Vec8d yl = to_double(dy.get_low()), yh = to_double(dy.get_high());
+  return Vec16i(round_to_int(sqrt(xl*xl + yl*yl)), round_to_int(sqrt(xh*xh + yh*yh)));
+}
+# elif INSTRSET >= 8 // AVXx - 256bits
+// vectors one pixel of E bytes to the left/right, for the separable engine
+template <int E>
+static inline __m256i lanes_prev(__m256i prev, __m256i v)
 {
-  assert(gray.isMatched(dy));
+  return _mm256_alignr_epi8(v, _mm256_permute2x128_si256(prev, v, 0x21), 16 - E);
+}
+template <int E>
+static inline __m256i lanes_next(__m256i v, __m256i next)
+{
+  return _mm256_alignr_epi8(_mm256_permute2x128_si256(v, next, 0x21), v, E);
+}
 
-  for (size_t z  = 0; z < gray.getBands(); ++z) {
-    window3x3_frame<uint8_t> gray3x3(gray);
-    gray3x3.draftFrame(gray, z);
+struct sobel_keep8 {
+  typedef Vec32uc vec;
+  enum { lanes = 32 };
+  static vec zero(void) { return vec(0); }
+  static vec prevLanes(const vec& prev, const vec& v) { return lanes_prev<1>(prev, v); }
+  static vec nextLanes(const vec& v, const vec& next) { return lanes_next<1>(v, next); }
+  static vec load(const uint8_t *p, int) { vec v; v.load(p); return v; }
+  static void store(const vec& v, int8_t *p, int n) { if (n == lanes) v.store(p); else v.store_partial(n, p); }
+};
+
+struct sobel_keep16 {
+  typedef Vec16us vec;
+  enum { lanes = 16 };
+  static vec zero(void) { return vec(0); }
+  static vec prevLanes(const vec& prev, const vec& v) { return lanes_prev<2>(prev, v); }
+  static vec nextLanes(const vec& v, const vec& next) { return lanes_next<2>(v, next); }
+  static vec load(const uint16_t *p, int) { vec v; v.load(p); return v; }
+  static void store(const vec& v, int16_t *p, int n) { if (n == lanes) v.store(p); else v.store_partial(n, p); }
+};
+
+struct sobel_widen8 {
+  typedef Vec16s vec;
+  enum { lanes = 16 };
+  static vec zero(void) { return vec(0); }
+  static vec prevLanes(const vec& prev, const vec& v) { return lanes_prev<2>(prev, v); }
+  static vec nextLanes(const vec& v, const vec& next) { return lanes_next<2>(v, next); }
+  static vec load(const uint8_t *p, int) { return _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)p)); }
+  static void store(const vec& v, int16_t *p, int n) { if (n == lanes) v.store(p); else v.store_partial(n, p); }
+};
+
+struct sobel_widen16 {
+  typedef Vec8i vec;
+  enum { lanes = 8 };
+  static vec zero(void) { return vec(0); }
+  static vec load(const uint16_t *p, int) { return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)p)); }
+  static void store(const vec& v, int32_t *p, int n) { if (n == lanes) v.store(p); else v.store_partial(n, p); }
+};
+
+struct sobel_widen8x32 {
+  typedef Vec8i vec;
+  enum { lanes = 8 };
+  static vec zero(void) { return vec(0); }
+  static vec load(const uint8_t *p, int) { return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)p)); }
+};
+
+struct sobel_signed16 {
+  typedef Vec16s vec;
+  enum { lanes = 16 };
+  static vec zero(void) { return vec(0); }
+  static vec load(const int16_t *p, int) { vec v; v.load(p); return v; }
+  static void store(const vec& v, int16_t *p, int n) { if (n == lanes) v.store(p); else v.store_partial(n, p); }
+};
+
+struct sobel_signed16x32 {
+  typedef Vec8i vec;
+  enum { lanes = 8 };
+  static vec zero(void) { return vec(0); }
+  static vec load(const int16_t *p, int) { return _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)p)); }
+  static void store(const vec& v, int32_t *p, int n) { if (n == lanes) v.store(p); else v.store_partial(n, p); }
+};
+
+struct sobel_signed32 {
+  typedef Vec8i vec;
+  enum { lanes = 8 };
+  static vec zero(void) { return vec(0); }
+  static vec load(const int32_t *p, int) { vec v; v.load(p); return v; }
+  static void store(const vec& v, int32_t *p, int n) { if (n == lanes) v.store(p); else v.store_partial(n, p); }
+};
+
+struct sobel_float32 {
+  typedef Vec8f vec;
+  enum { lanes = 8 };
+  static vec zero(void) { return vec(0.0f); }
+  static vec mulAdd(const vec& p, int weight, const vec& sum) { return mul_add(p, vec((float)weight), sum); }
+  static vec load(const float *p, int) { vec v; v.load(p); return v; }
+  static void store(const vec& v, float *p, int n) { if (n == lanes) v.store(p); else v.store_partial(n, p); }
+};
+
+struct sobel_float64 {
+  typedef Vec4d vec;
+  enum { lanes = 4 };
+  static vec zero(void) { return vec(0.0); }
+  static vec mulAdd(const vec& p, int weight, const vec& sum) { return mul_add(p, vec((double)weight), sum); }
+  static vec load(const double *p, int) { vec v; v.load(p); return v; }
+  static void store(const vec& v, double *p, int n) { if (n == lanes) v.store(p); else v.store_partial(n, p); }
+};
+
+// the magnitudes of 8-bit input and the orientation codes fit a signed
+// saturating pack
+static inline void store_narrow(const Vec8i& v, uint32_t *p, int n)
+{
+  if (n == 8) v.store(p);
+  else v.store_partial(n, p);
+}
+static inline void store_narrow(const Vec8i& v, uint16_t *p, int n)
+{
+  Vec8s w = _mm_packs_epi32(v.get_low(), v.get_high());
+  if (n == 8) w.store(p);
+  else w.store_partial(n, p);
+}
+static inline void store_narrow(const Vec8i& v, uint8_t *p, int n)
+{
+  __m128i w = _mm_packs_epi32(v.get_low(), v.get_high());
+  Vec16c c = _mm_packs_epi16(w, w);
+  if (n == 8) _mm_storel_epi64((__m128i *)p, c);
+  else c.store_partial(n, p);
+}
 
-    for (size_t y = 0; y < gray.getHeight(); ++y) {
-      int8_t *dyLine = dy.getLine(y, z);
-      uint8_t *prevLine = gray3x3.getPrevLine();
-      //uint8_t *currLine = gray3x3.getCurrLine();
-      uint8_t *nextLine = gray3x3.getNextLine();
+// the L2 norm of 16-bit input, see sobelNormL2()
+static inline Vec8i sobelNormL2(const Vec8i& dx, const Vec8i& dy, uint32_t)
+{
+  Vec4d xl = to_double(dx.get_low()), xh = to_double(dx.get_high());
+  Vec4d yl = to_double(dy.get_low()), yh = to_double(dy.get_high());
+  return Vec8i(round_to_int(sqrt(xl*xl + yl*yl)), round_to_int(sqrt(xh*xh + yh*yh)));
+}
+# else // SSE2 and SSE4.1 - 128bits
+// vectors one pixel of E bytes to the left/right, for the separable engine
+#  if INSTRSET >= 4 // SSSE3
+template <int E>
+static inline __m128i lanes_prev(__m128i prev, __m128i v) { return _mm_alignr_epi8(v, prev, 16 - E); }
+template <int E>
+static inline __m128i lanes_next(__m128i v, __m128i next) { return _mm_alignr_epi8(next, v, E); }
+#  endif
+
+struct sobel_keep8 {
+  typedef Vec16uc vec;
+  enum { lanes = 16 };
+  static vec zero(void) { return vec(0); }
+#  if INSTRSET >= 4
+  static vec prevLanes(const vec& prev, const vec& v) { return lanes_prev<1>(prev, v); }
+  static vec nextLanes(const vec& v, const vec& next) { return lanes_next<1>(v, next); }
+#  endif
+  static vec load(const uint8_t *p, int) { vec v; v.load(p); return v; }
+  static void store(const vec& v, int8_t *p, int n) { if (n == lanes) v.store(p); else v.store_partial(n, p); }
+};
+
+struct sobel_keep16 {
+  typedef Vec8us vec;
+  enum { lanes = 8 };
+  static vec zero(void) { return vec(0); }
+#  if INSTRSET >= 4
+  static vec prevLanes(const vec& prev, const vec& v) { return lanes_prev<2>(prev, v); }
+  static vec nextLanes(const vec& v, const vec& next) { return lanes_next<2>(v, next); }
+#  endif
+  static vec load(const uint16_t *p, int) { vec v; v.load(p); return v; }
+  static void store(const vec& v, int16_t *p, int n) { if (n == lanes) v.store(p); else v.store_partial(n, p); }
+};
+
+#  if INSTRSET >= 5 // SSE4.1
+struct sobel_widen8 {
+  typedef Vec8s vec;
+  enum { lanes = 8 };
+  static vec zero(void) { return vec(0); }
+  static vec load(const uint8_t *p, int) { return _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *)p)); }
+  static void store(const vec& v, int16_t *p, int n) { if (n == lanes) v.store(p); else v.store_partial(n, p); }
+};
+
+struct sobel_widen16 {
+  typedef Vec4i vec;
+  enum { lanes = 4 };
+  static vec zero(void) { return vec(0); }
+  static vec load(const uint16_t *p, int) { return _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *)p)); }
+  static void store(const vec& v, int32_t *p, int n) { if (n == lanes) v.store(p); else v.store_partial(n, p); }
+};
+
+struct sobel_widen8x32 {
+  typedef Vec4i vec;
+  enum { lanes = 4 };
+  static vec zero(void) { return vec(0); }
+  static vec load(const uint8_t *p, int)
+  {
+    int32_t q;
+    std::memcpy(&q, p, sizeof(q));
+    return _mm_cvtepu8_epi32(_mm_cvtsi32_si128(q));
+  }
+};
+
+struct sobel_signed16x32 {
+  typedef Vec4i vec;
+  enum { lanes = 4 };
+  static vec zero(void) { return vec(0); }
+  static vec load(const int16_t *p, int) { return _mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i *)p)); }
+  static void store(const vec& v, int32_t *p, int n) { if (n == lanes) v.store(p); else v.store_partial(n, p); }
+};
+#  else // SSE2
+struct sobel_widen8 {
+  typedef Vec8s vec;
+  enum { lanes = 8 };
+  static vec zero(void) { return vec(0); }
+  static vec load(const uint8_t *p, int)
+  {
+    return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)p), _mm_setzero_si128());
+  }
+  static void store(const vec& v, int16_t *p, int n) { if (n == lanes) v.store(p); else v.store_partial(n, p); }
+};
+
+struct sobel_widen16 {
+  typedef Vec4i vec;
+  enum { lanes = 4 };
+  static vec zero(void) { return vec(0); }
+  static vec load(const uint16_t *p, int)
+  {
+    return _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)p), _mm_setzero_si128());
+  }
+  static void store(const vec& v, int32_t *p, int n) { if (n == lanes) v.store(p); else v.store_partial(n, p); }
+};
+
+struct sobel_widen8x32 {
+  typedef Vec4i vec;
+  enum { lanes = 4 };
+  static vec zero(void) { return vec(0); }
+  static vec load(const uint8_t *p, int)
+  {
+    int32_t q;
+    std::memcpy(&q, p, sizeof(q));
+    __m128i w = _mm_unpacklo_epi8(_mm_cvtsi32_si128(q), _mm_setzero_si128());
+    return _mm_unpacklo_epi16(w, _mm_setzero_si128());
+  }
+};
+
+struct sobel_signed16x32 {
+  typedef Vec4i vec;
+  enum { lanes = 4 };
+  static vec zero(void) { return vec(0); }
+  static vec load(const int16_t *p, int)
+  {
+    __m128i w = _mm_loadl_epi64((const __m128i *)p);
+    return _mm_srai_epi32(_mm_unpacklo_epi16(w, w), 16);
+  }
+  static void store(const vec& v, int32_t *p, int n) { if (n == lanes) v.store(p); else v.store_partial(n, p); }
+};
+#  endif
+
+struct sobel_signed16 {
+  typedef Vec8s vec;
+  enum { lanes = 8 };
+  static vec zero(void) { return vec(0); }
+  static vec load(const int16_t *p, int) { vec v; v.load(p); return v; }
+  static void store(const vec& v, int16_t *p, int n) { if (n == lanes) v.store(p); else v.store_partial(n, p); }
+};
+
+struct sobel_signed32 {
+  typedef Vec4i vec;
+  enum { lanes = 4 };
+  static vec zero(void) { return vec(0); }
+  static vec load(const int32_t *p, int) { vec v; v.load(p); return v; }
+  static void store(const vec& v, int32_t *p, int n) { if (n == lanes) v.store(p); else v.store_partial(n, p); }
+};
+
+struct sobel_float32 {
+  typedef Vec4f vec;
+  enum { lanes = 4 };
+  static vec zero(void) { return vec(0.0f); }
+  static vec mulAdd(const vec& p, int weight, const vec& sum) { return mul_add(p, vec((float)weight), sum); }
+  static vec load(const float *p, int) { vec v; v.load(p); return v; }
+  static void store(const vec& v, float *p, int n) { if (n == lanes) v.store(p); else v.store_partial(n, p); }
+};
+
+struct sobel_float64 {
+  typedef Vec2d vec;
+  enum { lanes = 2 };
+  static vec zero(void) { return vec(0.0); }
+  static vec mulAdd(const vec& p, int weight, const vec& sum) { return mul_add(p, vec((double)weight), sum); }
+  static vec load(const double *p, int) { vec v; v.load(p); return v; }
+  static void store(const vec& v, double *p, int n) { if (n == lanes) v.store(p); else v.store_partial(n, p); }
+};
+
+// the magnitudes of 8-bit input and the orientation codes fit a signed
+// saturating pack
+static inline void store_narrow(const Vec4i& v, uint32_t *p, int n)
+{
+  if (n == 4) v.store(p);
+  else v.store_partial(n, p);
+}
+static inline void store_narrow(const Vec4i& v, uint16_t *p, int n)
+{
+  Vec8s w = _mm_packs_epi32(v, v);
+  if (n == 4) _mm_storel_epi64((__m128i *)p, w);
+  else w.store_partial(n, p);
+}
+static inline void store_narrow(const Vec4i& v, uint8_t *p, int n)
+{
+  __m128i w = _mm_packs_epi32(v, v);
+  int32_t q = _mm_cvtsi128_si32(_mm_packs_epi16(w, w));
+  std::memcpy(p, &q, n);
+}
 
-      /*
-      nwVec|nnVec|neVec
-      -----+-----+-----
-      wwVec|ooVec|eeVec
-      -----+-----+-----
-      swVec|ssVec|seVec
-      */
-#pragma omp parallel for
-#if defined(__x86_64__) || defined(__i386__)
-# if INSTRSET >= 8 // AVXx - 256bits
-      for (size_t x = 0; x < gray.getWidth(); x += 32) {
-	Vec32uc nwVec, nnVec, neVec;
-	nwVec.load(&prevLine[(int)x-1]), nnVec.load(&prevLine[(int)x+0]), neVec.load(&prevLine[(int)x+1]);
-	/*
-	Vec32uc wwVec, eeVec;
-	wwVec.load(&currLine[(int)x-1]), eeVec.load(&currLine[(int)x+0]);
-	*/
-	Vec32uc swVec, ssVec, seVec;
-	swVec.load(&nextLine[(int)x-1]), ssVec.load(&nextLine[(int)x+0]), seVec.load(&nextLine[(int)x+1]);
-	Vec32c dyVec =
-	  -(nwVec>>3) - (nnVec>>2) - (neVec>>3)
-	  +(swVec>>3) + (ssVec>>2) + (seVec>>3);
-	dyVec.store(&dyLine[x]);
-      }
-# elif INSTRSET >= 2 // SSE2 - 128bits
-      for (size_t x = 0; x < gray.getWidth(); x += 16) {
-	Vec16uc nwVec, nnVec, neVec;
-	nwVec.load(&prevLine[(int)x-1]), nnVec.load(&prevLine[(int)x+0]), neVec.load(&prevLine[(int)x+1]);
-	/*
-	Vec16uc wwVec, eeVec;
-	wwVec.load(&currLine[(int)x-1]), eeVec.load(&currLine[(int)x+1]);
-	*/
-	Vec16uc swVec, ssVec, seVec;
-	swVec.load(&nextLine[(int)x-1]), ssVec.load(&nextLine[(int)x+0]), seVec.load(&nextLine[(int)x+1]);
-	Vec16c dyVec =
-	  -(nwVec>>3) - (nnVec>>2) - (neVec>>3)
-	  +(swVec>>3) + (ssVec>>2) + (seVec>>3);
-	dyVec.store(&dyLine[x]);
-      }
+// the L2 norm of 16-bit input, see sobelNormL2()
+static inline Vec4i sobelNormL2(const Vec4i& dx, const Vec4i& dy, uint32_t)
+{
+  Vec2d xl = to_double_low(dx), xh = to_double_high(dx);
+  Vec2d yl = to_double_low(dy), yh = to_double_high(dy);
+  return round_to_int(sqrt(xl*xl + yl*yl), sqrt(xh*xh + yh*yh));
+}
 # endif
 #elif defined(__ARM_NEON__)
-      for (size_t x = 0; x < gray.getWidth(); x += 16) {
-	uint8x16_t nwVec, nnVec, neVec;
-	nwVec = vld1q_u8((const uint8_t *)&prevLine[(int)x-1]);
-	nnVec = vld1q_u8((const uint8_t *)&prevLine[(int)x+0]);
-	neVec = vld1q_u8((const uint8_t *)&prevLine[(int)x+1]);
-	/*
-	uint8x16_t wwVec, eeVec;
-	wwVec = vld1q_u8((const uint8_t *)&currLine[(int)x-1]);
-	eeVec = vld1q_u8((const uint8_t *)&currLine[(int)x+]);
-	*/
-	uint8x16_t swVec, ssVec, seVec;
-	swVec = vld1q_u8((const uint8_t *)&nextLine[(int)x-1]);
-	ssVec = vld1q_u8((const uint8_t *)&nextLine[(int)x+0]);
-	seVec = vld1q_u8((const uint8_t *)&nextLine[(int)x+1]);
-	
-	int8x16_t tsumVec, bsumVec;
-	uint8x16_t tempVec;
-	tempVec = vdupq_n_u8((uint8_t)0);
-	tempVec = vsra_n_u8(tempVec, nwVec, 3);
-	tempVec = vsra_n_u8(tempVec, nnVec, 2);
-	tempVec = vsra_n_u8(tempVec, neVec, 3);
-	tsumVec = vreinterpretq_s8_u8(tempVec);
-	
-	tempVec = vdupq_n_u8((uint8_t)0);
-	tempVec = vsra_n_u8(tempVec, swVec, 3);
-	tempVec = vsra_n_u8(tempVec, ssVec, 2);
-	tempVec = vsra_n_u8(tempVec, seVec, 3);
-	bsumVec = vreinterpretq_s8_u8(tempVec);
-	
-	int8x16_t dyVec = vsubq_s8(bsum, tsum);
-	vst1q_s8((int8_t *)&dyLine[x], dyVec);
-      }
-#endif
-      gray3x3.shiftFrame(gray, z);
-    }
+// the NEON vectors are GCC vector types, so +, -, << and >> just work, and
+// the partial store at the end of a line is a memcpy of their lanes
+struct sobel_keep8 {
+  typedef uint8x16_t vec;
+  enum { lanes = 16 };
+  static vec zero(void) { return vdupq_n_u8(0); }
+  static vec load(const uint8_t *p, int) { return vld1q_u8(p); }
+  static void store(const vec& v, int8_t *p, int n)
+  {
+    if (n == lanes) vst1q_s8(p, vreinterpretq_s8_u8(v));
+    else std::memcpy(p, &v, n * sizeof(*p));
   }
-}
+};
+
+struct sobel_keep16 {
+  typedef uint16x8_t vec;
+  enum { lanes = 8 };
+  static vec zero(void) { return vdupq_n_u16(0); }
+  static vec load(const uint16_t *p, int) { return vld1q_u16(p); }
+  static void store(const vec& v, int16_t *p, int n)
+  {
+    if (n == lanes) vst1q_s16(p, vreinterpretq_s16_u16(v));
+    else std::memcpy(p, &v, n * sizeof(*p));
+  }
+};
+
+struct sobel_widen8 {
+  typedef int16x8_t vec;
+  enum { lanes = 8 };
+  static vec zero(void) { return vdupq_n_s16(0); }
+  static vec load(const uint8_t *p, int) { return vreinterpretq_s16_u16(vmovl_u8(vld1_u8(p))); }
+  static void store(const vec& v, int16_t *p, int n)
+  {
+    if (n == lanes) vst1q_s16(p, v);
+    else std::memcpy(p, &v, n * sizeof(*p));
+  }
+};
+
+struct sobel_widen16 {
+  typedef int32x4_t vec;
+  enum { lanes = 4 };
+  static vec zero(void) { return vdupq_n_s32(0); }
+  static vec load(const uint16_t *p, int) { return vreinterpretq_s32_u32(vmovl_u16(vld1_u16(p))); }
+  static void store(const vec& v, int32_t *p, int n)
+  {
+    if (n == lanes) vst1q_s32(p, v);
+    else std::memcpy(p, &v, n * sizeof(*p));
+  }
+};
+
+struct sobel_signed16 {
+  typedef int16x8_t vec;
+  enum { lanes = 8 };
+  static vec zero(void) { return vdupq_n_s16(0); }
+  static vec load(const int16_t *p, int) { return vld1q_s16(p); }
+  static void store(const vec& v, int16_t *p, int n)
+  {
+    if (n == lanes) vst1q_s16(p, v);
+    else std::memcpy(p, &v, n * sizeof(*p));
+  }
+};
+
+struct sobel_signed16x32 {
+  typedef int32x4_t vec;
+  enum { lanes = 4 };
+  static vec zero(void) { return vdupq_n_s32(0); }
+  static vec load(const int16_t *p, int) { return vmovl_s16(vld1_s16(p)); }
+  static void store(const vec& v, int32_t *p, int n)
+  {
+    if (n == lanes) vst1q_s32(p, v);
+    else std::memcpy(p, &v, n * sizeof(*p));
+  }
+};
+
+struct sobel_signed32 {
+  typedef int32x4_t vec;
+  enum { lanes = 4 };
+  static vec zero(void) { return vdupq_n_s32(0); }
+  static vec load(const int32_t *p, int) { return vld1q_s32(p); }
+  static void store(const vec& v, int32_t *p, int n)
+  {
+    if (n == lanes) vst1q_s32(p, v);
+    else std::memcpy(p, &v, n * sizeof(*p));
+  }
+};
+
+struct sobel_float32 {
+  typedef float32x4_t vec;
+  enum { lanes = 4 };
+  static vec zero(void) { return vdupq_n_f32(0.0f); }
+#  if defined(__ARM_FEATURE_FMA)
+  static vec mulAdd(const vec& p, int weight, const vec& sum) { return vfmaq_n_f32(sum, p, (float)weight); }
+#  else
+  static vec mulAdd(const vec& p, int weight, const vec& sum) { return vmlaq_n_f32(sum, p, (float)weight); }
+#  endif
+  static vec load(const float *p, int) { return vld1q_f32(p); }
+  static void store(const vec& v, float *p, int n)
+  {
+    if (n == lanes) vst1q_f32(p, v);
+    else std::memcpy(p, &v, n * sizeof(*p));
+  }
+};
+
+#  if defined(__aarch64__)
+struct sobel_float64 {
+  typedef float64x2_t vec;
+  enum { lanes = 2 };
+  static vec zero(void) { return vdupq_n_f64(0.0); }
+  static vec mulAdd(const vec& p, int weight, const vec& sum) { return vfmaq_n_f64(sum, p, (double)weight); }
+  static vec load(const double *p, int) { return vld1q_f64(p); }
+  static void store(const vec& v, double *p, int n)
+  {
+    if (n == lanes) vst1q_f64(p, v);
+    else std::memcpy(p, &v, n * sizeof(*p));
+  }
+};
+#  endif
+#endif
 
-inline void edgeSobelKernel(cpixmap<uint8_t>& gray, cpixmap<int8_t>& dx, cpixmap<int8_t>& dy)
-{
-  assert(gray.isMatched(dx));
-  assert(gray.isMatched(dy));
-  
-  for (size_t z  = 0; z < gray.getBands(); ++z) {
-    window3x3_frame<uint8_t> gray3x3(gray);
-    gray3x3.draftFrame(gray, z);
-
-    for (size_t y = 0; y < gray.getHeight(); ++y) {
-      int8_t *dxLine = dx.getLine(y, z);
-      int8_t *dyLine = dy.getLine(y, z);
-      uint8_t *prevLine = gray3x3.getPrevLine();
-      uint8_t *currLine = gray3x3.getCurrLine();
-      uint8_t *nextLine = gray3x3.getNextLine();
-
-      /*
-      nwVec|nnVec|neVec
-      -----+-----+-----
-      wwVec|ooVec|eeVec
-      -----+-----+-----
-      swVec|ssVec|seVec
-      */
-#pragma omp parallel for
-#if defined(__x86_64__) || defined(__i386__)
-# if INSTRSET >= 8 // AVXx - 256bits
-      for (size_t x = 0; x < gray.getWidth(); x += 32) {
-	Vec32uc nwVec, nnVec, neVec;
-	nwVec.load(&prevLine[(int)x-1]), nnVec.load(&prevLine[(int)x+0]), neVec.load(&prevLine[(int)x+1]);
-	Vec32uc wwVec, eeVec;
-	wwVec.load(&currLine[(int)x-1]), eeVec.load(&currLine[(int)x+0]);
-	Vec32uc swVec, ssVec, seVec;
-	swVec.load(&nextLine[(int)x-1]), ssVec.load(&nextLine[(int)x+0]), seVec.load(&nextLine[(int)x+1]);
-	Vec32c dxVec =
-	  -(nwVec>>3) + (neVec>>3)
-	  -(wwVec>>2) + (eeVec>>2)
-	  -(swVec>>3) + (seVec>>3);
-	dxVec.store(&dxLine[x]);
-	Vec32c dyVec =
-	  -(nwVec>>3) - (nnVec>>2) - (neVec>>3)
-	  +(swVec>>3) + (ssVec>>2) + (seVec>>3);
-	dyVec.store(&dyLine[x]);
-      }
-# elif INSTRSET >= 2 // SSE2 - 128bits
-      for (size_t x = 0; x < gray.getWidth(); x += 16) {
-	Vec16uc nwVec, nnVec, neVec;
-	nwVec.load(&prevLine[(int)x-1]), nnVec.load(&prevLine[(int)x+0]), neVec.load(&prevLine[(int)x+1]);
-	Vec16uc wwVec, eeVec;
-	wwVec.load(&currLine[(int)x-1]), eeVec.load(&currLine[(int)x+1]);
-	Vec16uc swVec, ssVec, seVec;
-	swVec.load(&nextLine[(int)x-1]), ssVec.load(&nextLine[(int)x+0]), seVec.load(&nextLine[(int)x+1]);
-	Vec16c dxVec =
-	  -(nwVec>>3) + (neVec>>3)
-	  -(wwVec>>2) + (eeVec>>2)
-	  -(swVec>>3) + (seVec>>3);
-	dxVec.store(&dxLine[x]);
-	Vec16c dyVec =
-	  -(nwVec>>3) - (nnVec>>2) - (neVec>>3)
-	  +(swVec>>3) + (ssVec>>2) + (seVec>>3);
-	dyVec.store(&dyLine[x]);
-      }
+// lane policy of each input/output pair
+template <typename T, typename S>
+struct sobel_lanes {};
+template <>
+struct sobel_lanes<uint8_t, int8_t> { typedef sobel_keep8 type; };
+template <>
+struct sobel_lanes<uint16_t, int16_t> { typedef sobel_keep16 type; };
+template <>
+struct sobel_lanes<uint8_t, int16_t> { typedef sobel_widen8 type; };
+template <>
+struct sobel_lanes<uint16_t, int32_t> { typedef sobel_widen16 type; };
+template <>
+struct sobel_lanes<int16_t, int16_t> { typedef sobel_signed16 type; };
+template <>
+struct sobel_lanes<int16_t, int32_t> { typedef sobel_signed16x32 type; };
+template <>
+struct sobel_lanes<int32_t, int32_t> { typedef sobel_signed32 type; };
+template <>
+struct sobel_lanes<float, float> { typedef sobel_float32 type; };
+#if !defined(__ARM_NEON__) || defined(__aarch64__)
+template <>
+struct sobel_lanes<double, double> { typedef sobel_float64 type; };
+#endif
+
+/*
+  The separable engine (see stencil3x3SeparableLanes) beats the fused one
+  where the lanes keep the pixel width, from SSSE3 to AVX2, e.g. uint8 ->
+  int8 by x1.2-1.6 on AVX2, and is on par with it on AVX-512 (x0.95-1.1),
+  where both are bound by memory. Where the lanes widen it only pays off
+  for uint8 -> int16 on AVX2 and AVX-512, by x1.2-1.3 on lines in the
+  cache, as the widened columns take twice the registers; not on SSE4.1,
+  nor for uint16 -> int32. SSE2 has no alignr to move the columns by one
+  pixel, see sobel.separable.bench.cpp. NEON keeps the fused engine, it
+  is not measured.
+*/
+template <typename L>
+struct sobel_separable3x3 : std::false_type {};
+#if (defined(__x86_64__) || defined(__i386__)) && INSTRSET >= 4
+template <>
+struct sobel_separable3x3<sobel_keep8> : std::true_type {};
+template <>
+struct sobel_separable3x3<sobel_keep16> : std::true_type {};
+# if INSTRSET >= 8
+template <>
+struct sobel_separable3x3<sobel_widen8> : std::true_type {};
 # endif
-#elif defined(__ARM_NEON__)
-      for (size_t x = 0; x < gray.getWidth(); x += 16) {
-	uint8x16_t nwVec, nnVec, neVec;
-	nwVec = vld1q_u8((const uint8_t *)&prevLine[(int)x-1]);
-	nnVec = vld1q_u8((const uint8_t *)&prevLine[(int)x+0]);
-	neVec = vld1q_u8((const uint8_t *)&prevLine[(int)x+1]);
-	uint8x16_t wwVec, eeVec;
-	wwVec = vld1q_u8((const uint8_t *)&currLine[(int)x-1]);
-	eeVec = vld1q_u8((const uint8_t *)&currLine[(int)x+]);
-	uint8x16_t swVec, ssVec, seVec;
-	swVec = vld1q_u8((const uint8_t *)&nextLine[(int)x-1]);
-	ssVec = vld1q_u8((const uint8_t *)&nextLine[(int)x+0]);
-	seVec = vld1q_u8((const uint8_t *)&nextLine[(int)x+1]);
-
-	int8x16_t lsumVec, rsumVec;
-	uint8x16_t tempVec;
-	tempVec = vdupq_n_u8((uint8_t)0);
-	tempVec = vsra_n_u8(tempVec, nwVec, 3);
-	tempVec = vsra_n_u8(tempVec, wwVec, 2);
-	tempVec = vsra_n_u8(tempVec, swVec, 3);
-	lsumVec = vreinterpretq_s8_u8(tempVec);
-	
-	tempVec = vdupq_n_u8((uint8_t)0);
-	tempVec = vsra_n_u8(tempVec, neVec, 3);
-	tempVec = vsra_n_u8(tempVec, eeVec, 2);
-	tempVec = vsra_n_u8(tempVec, seVec, 3);
-	rsumVec = vreinterpretq_s8_u8(tempVec);
-	
-	int8x16_t dxVec = vsubq_s8(rsum, lsum);
-	vst1q_s8((int8_t *)&dxLine[x], dxVec);
-
-	int8x16_t tsumVec, bsumVec;
-	tempVec = vdupq_n_u8((uint8_t)0);
-	tempVec = vsra_n_u8(tempVec, nwVec, 3);
-	tempVec = vsra_n_u8(tempVec, nnVec, 2);
-	tempVec = vsra_n_u8(tempVec, neVec, 3);
-	tsumVec = vreinterpretq_s8_u8(tempVec);
-	
-	tempVec = vdupq_n_u8((uint8_t)0);
-	tempVec = vsra_n_u8(tempVec, swVec, 3);
-	tempVec = vsra_n_u8(tempVec, ssVec, 2);
-	tempVec = vsra_n_u8(tempVec, seVec, 3);
-	bsumVec = vreinterpretq_s8_u8(tempVec);
-	
-	int8x16_t dyVec = vsubq_s8(bsum, tsum);
-	vst1q_s8((int8_t *)&dyLine[x], dyVec);
-      }
 #endif
-      gray3x3.shiftFrame(gray, z);
-    }
-  }
+
+template <typename K, typename L, typename T, typename S>
+inline void sobel3x3Lanes(const T *prevLine, const T *currLine, const T *nextLine,
+			  S *outLine, size_t width, std::false_type)
+{
+  stencil3x3Lanes<K, L>(prevLine, currLine, nextLine, outLine, width);
 }
 
-inline void edgeHSobelKernel(cpixmap<uint16_t>& gray, cpixmap<int16_t>& dx)
+template <typename K, typename L, typename T, typename S>
+inline void sobel3x3Lanes(const T *prevLine, const T *currLine, const T *nextLine,
+			  S *outLine, size_t width, std::true_type)
 {
-  assert(gray.isMatched(dx));
+  stencil3x3SeparableLanes<K, L>(prevLine, currLine, nextLine, outLine, width);
+}
 
-  for (size_t z  = 0; z < gray.getBands(); ++z) {
-    window3x3_frame<uint16_t> gray3x3(gray);
-    gray3x3.draftFrame(gray, z);
+template <typename KX, typename KY, typename L, typename T, typename S>
+inline void sobel3x3PairLanes(const T *prevLine, const T *currLine, const T *nextLine,
+			      S *xLine, S *yLine, size_t width, std::false_type)
+{
+  stencil3x3PairLanes<KX, KY, L>(prevLine, currLine, nextLine, xLine, yLine, width);
+}
 
-    for (size_t y = 0; y < gray.getHeight(); ++y) {
-      int16_t *dxLine = dx.getLine(y, z);
-      uint16_t *prevLine = gray3x3.getPrevLine();
-      uint16_t *currLine = gray3x3.getCurrLine();
-      uint16_t *nextLine = gray3x3.getNextLine();
+template <typename KX, typename KY, typename L, typename T, typename S>
+inline void sobel3x3PairLanes(const T *prevLine, const T *currLine, const T *nextLine,
+			      S *xLine, S *yLine, size_t width, std::true_type)
+{
+  stencil3x3SeparablePairLanes<KX, KY, L>(prevLine, currLine, nextLine, xLine, yLine, width);
+}
 
-      /*
-      nwVec|nnVec|neVec
-      -----+-----+-----
-      wwVec|ooVec|eeVec
-      -----+-----+-----
-      swVec|ssVec|seVec
-      */
-#pragma omp parallel for
-#if defined(__x86_64__) || defined(__i386__)
-# if INSTRSET >= 8 // AVXx - 256bits
-      for (size_t x = 0; x < gray.getWidth(); x += 16) {
-	Vec16us nwVec, /*nnVec,*/ neVec;
-	nwVec.load(&prevLine[(int)x-1]), /*nnVec.load(&prevLine[(int)x+0]),*/ neVec.load(&prevLine[(int)x+1]);
-	Vec16us wwVec, eeVec;
-	wwVec.load(&currLine[(int)x-1]), eeVec.load(&currLine[(int)x+1]);
-	Vec16us swVec, /*ssVec,*/ seVec;
-	swVec.load(&nextLine[(int)x-1]), /*ssVec.load(&nextLine[(int)x+0]),*/ seVec.load(&nextLine[(int)x+1]);
-	Vec16s dxVec =
-	  -(nwVec>>3) + (neVec>>3)
-	  -(wwVec>>2) + (eeVec>>2)
-	  -(swVec>>3) + (seVec>>3);
-	dxVec.store(&dxLine[x]);
-      }
-# elif INSTRSET >= 2 // SSE2 - 128bits
-      for (size_t x = 0; x < gray.getWidth(); x += 8) {
-	Vec8us nwVec, /*nnVec,*/ neVec;
-	nwVec.load(&prevLine[(int)x-1]), /*nnVec.load(&prevLine[(int)x+0]),*/ neVec.load(&prevLine[(int)x+1]);
-	Vec8us wwVec, eeVec;
-	wwVec.load(&currLine[(int)x-1]), eeVec.load(&currLine[(int)x+1]);
-	Vec8us swVec, /*ssVec,*/ seVec;
-	swVec.load(&nextLine[(int)x-1]), /*ssVec.load(&nextLine[(int)x+0]),*/ seVec.load(&nextLine[(int)x+1]);
-	Vec8s dxVec =
-	  -(nwVec>>3) + (neVec>>3)
-	  -(wwVec>>2) + (eeVec>>2)
-	  -(swVec>>3) + (seVec>>3);
-	dxVec.store(&dxLine[x]);
-      }
-# endif
-#elif defined(__ARM_NEON__)
-      for (size_t x = 0; x < gray.getWidth(); x += 8) {
-	uint16x8_t nwVec, /*nnVec,*/ neVec;
-	nwVec = vld1q_u16((const uint16_t *)&prevLine[(int)x-1]);
-	//nnVec = vld1q_u16((const uint16_t *)&prevLine[(int)x+0]);
-	neVec = vld1q_u16((const uint16_t *)&prevLine[(int)x+1]);
-	uint16x8_t wwVec, eeVec;
-	wwVec = vld1q_u16((const uint16_t *)&currLine[(int)x-1]);
-	eeVec = vld1q_u16((const uint16_t *)&currLine[(int)x+1]);
-	uint16x8_t swVec, /*ssVec,*/ seVec;
-	swVec = vld1q_u16((const uint16_t *)&nextLine[(int)x-1]);
-	//ssVec = vld1q_u16((const uint16_t *)&nextLine[(int)x+0]);
-	seVec = vld1q_u16((const uint16_t *)&nextLine[(int)x+1]);
-	
-	int16x8_t lsumVec, rsumVec;
-	uint16x8_t tempVec;
-	tempVec = vdupq_n_u16((uint16_t)0);
-	tempVec = vsra_n_u16(tempVec, nwVec, 3);
-	tempVec = vsra_n_u16(tempVec, wwVec, 2);
-	tempVec = vsra_n_u16(tempVec, swVec, 3);
-	lsumVec = vreinterpretq_s16_u16(tempVec);
-	
-	tempVec = vdupq_n_u16((uint16_t)0);
-	tempVec = vsra_n_u16(tempVec, neVec, 3);
-	tempVec = vsra_n_u16(tempVec, eeVec, 2);
-	tempVec = vsra_n_u16(tempVec, seVec, 3);
-	rsumVec = vreinterpretq_s16_u16(tempVec);
-	
-	int16x8_t dxVec = vsubq_s16(rsum, lsum);
-	vst1q_s16((int16_t *)&dxLine[x], dxVec);
-      }
-#endif
-      gray3x3.shiftFrame(gray, z);
-    }
-  }
+template <typename K, typename L, typename T, typename S>
+inline void sobel3x3BlockLanes(const T *const *lines, S *const *outLines, size_t width, std::false_type)
+{
+  stencil3x3BlockLanes<K, L, STENCIL_BLOCK_ROWS>(lines, outLines, width);
 }
 
-inline void edgeVSobelKernel(cpixmap<uint16_t>& gray, cpixmap<int16_t>& dy)
+template <typename K, typename L, typename T, typename S>
+inline void sobel3x3BlockLanes(const T *const *lines, S *const *outLines, size_t width, std::true_type)
 {
-  assert(gray.isMatched(dy));
-  
+  stencil3x3SeparableBlockLanes<K, L, STENCIL_BLOCK_ROWS>(lines, outLines, width);
+}
 
-  for (size_t z  = 0; z < gray.getBands(); ++z) {
-    window3x3_frame<uint16_t> gray3x3(gray);
-    gray3x3.draftFrame(gray, z);
+template <typename KX, typename KY, typename L, typename T, typename S>
+inline void sobel3x3PairBlockLanes(const T *const *lines, S *const *xLines, S *const *yLines, size_t width,
+				   std::false_type)
+{
+  stencil3x3PairBlockLanes<KX, KY, L, STENCIL_BLOCK_ROWS>(lines, xLines, yLines, width);
+}
 
-    for (size_t y = 0; y < gray.getHeight(); ++y) {
-      int16_t *dyLine = dy.getLine(y, z);
-      uint16_t *prevLine = gray3x3.getPrevLine();
-      //uint16_t *currLine = gray3x3.getCurrLine();
-      uint16_t *nextLine = gray3x3.getNextLine();
+template <typename KX, typename KY, typename L, typename T, typename S>
+inline void sobel3x3PairBlockLanes(const T *const *lines, S *const *xLines, S *const *yLines, size_t width,
+				   std::true_type)
+{
+  stencil3x3SeparablePairBlockLanes<KX, KY, L, STENCIL_BLOCK_ROWS>(lines, xLines, yLines, width);
+}
 
-      /*
-      nwVec|nnVec|neVec
-      -----+-----+-----
-      wwVec|ooVec|eeVec
-      -----+-----+-----
-      swVec|ssVec|seVec
-      */
-#pragma omp parallel for
-#if defined(__x86_64__) || defined(__i386__)
-# if INSTRSET >= 8 // AVXx - 256bits
-      for (size_t x = 0; x < gray.getWidth(); x += 16) {
-	Vec16us nwVec, nnVec, neVec;
-	nwVec.load(&prevLine[(int)x-1]), nnVec.load(&prevLine[(int)x+0]), neVec.load(&prevLine[(int)x+1]);
-	/*
-	Vec16us wwVec, eeVec;
-	wwVec.load(&currLine[(int)x-1]), eeVec.load(&currLine[(int)x+1]);
-	*/
-	Vec16us swVec, ssVec, seVec;
-	swVec.load(&nextLine[(int)x-1]), ssVec.load(&nextLine[(int)x+0]), seVec.load(&nextLine[(int)x+1]);
-	Vec16s dyVec =
-	  -(nwVec>>3) - (nnVec>>2) - (neVec>>3)
-	  +(swVec>>3) + (ssVec>>2) + (seVec>>3);
-	dyVec.store(&dyLine[x]);
-      }
-# elif INSTRSET >= 2 // SSE2 - 128bits
-      for (size_t x = 0; x < gray.getWidth(); x += 8) {
-	Vec8us nwVec, nnVec, neVec;
-	nwVec.load(&prevLine[(int)x-1]), nnVec.load(&prevLine[(int)x+0]), neVec.load(&prevLine[(int)x+1]);
-	/*
-	Vec8us wwVec, eeVec;
-	wwVec.load(&currLine[(int)x-1]), eeVec.load(&currLine[(int)x+1]);
-	*/
-	Vec8us swVec, ssVec, seVec;
-	swVec.load(&nextLine[(int)x-1]), ssVec.load(&nextLine[(int)x+0]), seVec.load(&nextLine[(int)x+1]);
-	Vec8s dyVec =
-	  -(nwVec>>3) - (nnVec>>2) - (neVec>>3)
-	  +(swVec>>3) + (ssVec>>2) + (seVec>>3);
-	dyVec.store(&dyLine[x]);
-      }
-# endif
-#elif defined(__ARM_NEON__)
-      for (size_t x = 0; x < gray.getWidth(); x += 8) {
-	uint16x8_t nwVec, nnVec, neVec;
-	nwVec = vld1q_u16((const uint16_t *)&prevLine[(int)x-1]);
-	nnVec = vld1q_u16((const uint16_t *)&prevLine[(int)x+0]);
-	neVec = vld1q_u16((const uint16_t *)&prevLine[(int)x+1]);
-	/*
-	uint16x8_t wwVec, eeVec;
-	wwVec = vld1q_u16((const uint16_t *)&currLine[(int)x-1]);
-	eeVec = vld1q_u16((const uint16_t *)&currLine[(int)x+1]);
-	*/
-	uint16x8_t swVec, ssVec, seVec;
-	swVec = vld1q_u16((const uint16_t *)&nextLine[(int)x-1]);
-	ssVec = vld1q_u16((const uint16_t *)&nextLine[(int)x+0]);
-	seVec = vld1q_u16((const uint16_t *)&nextLine[(int)x+1]);
-	
-	int16x8_t tsumVec, bsumVec;
-	uint16x8_t tempVec;
-	tempVec = vdupq_n_u16((uint16_t)0);
-	tempVec = vsra_n_u16(tempVec, nwVec, 3);
-	tempVec = vsra_n_u16(tempVec, nnVec, 2);
-	tempVec = vsra_n_u16(tempVec, neVec, 3);
-	tsumVec = vreinterpretq_s16_u16(tempVec);
-	
-	tempVec = vdupq_n_u16((uint16_t)0);
-	tempVec = vsra_n_u16(tempVec, swVec, 3);
-	tempVec = vsra_n_u16(tempVec, ssVec, 2);
-	tempVec = vsra_n_u16(tempVec, seVec, 3);
-	bsumVec = vreinterpretq_s16_u16(tempVec);
-	
-	int16x8_t dyVec = vsubq_s16(bsum, tsum);
-	vst1q_s16((int16_t *)&dyLine[x], dyVec);
-      }
-#endif
-      gray3x3.shiftFrame(gray, z);
-    }
-  }
+/*
+  One output line of the stencil filter K, with the lossy taps for a
+  same-width output (uint8 -> int8) and the exact ones for a widened one
+  (uint8 -> int16), see stencil_taps. The engine is the fused or the
+  separable one, whichever sobel_separable3x3 picks for the lanes.
+*/
+template <typename K, typename T, typename S>
+inline void stencil3x3Line(const T *prevLine, const T *currLine, const T *nextLine,
+			   S *outLine, size_t width)
+{
+  typedef typename sobel_lanes<T, S>::type L;
+  sobel3x3Lanes<typename stencil_taps<K, T, S>::type, L>
+    (prevLine, currLine, nextLine, outLine, width, sobel_separable3x3<L>());
 }
 
-inline void edgeSobelKernel(cpixmap<uint16_t>& gray, cpixmap<int16_t>& dx, cpixmap<int16_t>& dy)
+template <typename KX, typename KY, typename T, typename S>
+inline void stencil3x3PairLine(const T *prevLine, const T *currLine, const T *nextLine,
+			       S *xLine, S *yLine, size_t width)
 {
-  assert(gray.isMatched(dx));
-  assert(gray.isMatched(dy));
+  typedef typename sobel_lanes<T, S>::type L;
+  sobel3x3PairLanes<typename stencil_taps<KX, T, S>::type, typename stencil_taps<KY, T, S>::type, L>
+    (prevLine, currLine, nextLine, xLine, yLine, width, sobel_separable3x3<L>());
+}
 
-  for (size_t z  = 0; z < gray.getBands(); ++z) {
-    window3x3_frame<uint16_t> gray3x3(gray);
-    gray3x3.draftFrame(gray, z);
+/*
+  STENCIL_BLOCK_ROWS output lines of the stencil filter K from the lines
+  -1..STENCIL_BLOCK_ROWS of a window3x3_frame over a block of rows, see
+  stencil3x3BlockLanes().
+*/
+template <typename K, typename T, typename S>
+inline void stencil3x3BlockLine(const T *const *lines, S *const *outLines, size_t width)
+{
+  typedef typename sobel_lanes<T, S>::type L;
+  sobel3x3BlockLanes<typename stencil_taps<K, T, S>::type, L>(lines, outLines, width, sobel_separable3x3<L>());
+}
 
-    for (size_t y = 0; y < gray.getHeight(); ++y) {
-      int16_t *dxLine = dx.getLine(y, z);
-      int16_t *dyLine = dy.getLine(y, z);
-      uint16_t *prevLine = gray3x3.getPrevLine();
-      uint16_t *currLine = gray3x3.getCurrLine();
-      uint16_t *nextLine = gray3x3.getNextLine();
+template <typename KX, typename KY, typename T, typename S>
+inline void stencil3x3PairBlockLine(const T *const *lines, S *const *xLines, S *const *yLines, size_t width)
+{
+  typedef typename sobel_lanes<T, S>::type L;
+  sobel3x3PairBlockLanes<typename stencil_taps<KX, T, S>::type, typename stencil_taps<KY, T, S>::type, L>
+    (lines, xLines, yLines, width, sobel_separable3x3<L>());
+}
+
+/*
+  One output line of the separable stencil K of radius R, e.g.
+  sobel5x5_dx_stencil, from the lines -R..R of a window_frame<T, R>: the
+  column sums are kept in sobel_widened<T> lanes, which hold those of
+  the 5x5 and 7x7 kernels, and the row sums go to S.
+*/
+template <typename K, typename T, typename S>
+inline void stencilSeparableLine(const T *const *lines, S *outLine, size_t width)
+{
+  typedef typename sobel_widened<T>::type I;
+  stencilSeparableLanes<K, typename sobel_lanes<T, I>::type, typename sobel_lanes<I, S>::type, I>
+    (lines, outLine, width);
+}
+
+template <typename KX, typename KY, typename T, typename S>
+inline void stencilSeparablePairLine(const T *const *lines, S *xLine, S *yLine, size_t width)
+{
+  typedef typename sobel_widened<T>::type I;
+  stencilSeparablePairLanes<KX, KY, typename sobel_lanes<T, I>::type, typename sobel_lanes<I, S>::type, I>
+    (lines, xLine, yLine, width);
+}
 
-      /*
-      nwVec|nnVec|neVec
-      -----+-----+-----
-      wwVec|ooVec|eeVec
-      -----+-----+-----
-      swVec|ssVec|seVec
-      */
-#pragma omp parallel for
 #if defined(__x86_64__) || defined(__i386__)
-# if INSTRSET >= 8 // AVXx - 256bits
-      for (size_t x = 0; x < gray.getWidth(); x += 16) {
-	Vec16us nwVec, nnVec, neVec;
-	nwVec.load(&prevLine[(int)x-1]), nnVec.load(&prevLine[(int)x+0]), neVec.load(&prevLine[(int)x+1]);
-	Vec16us wwVec, eeVec;
-	wwVec.load(&currLine[(int)x-1]), eeVec.load(&currLine[(int)x+1]);
-	Vec16us swVec, ssVec, seVec;
-	swVec.load(&nextLine[(int)x-1]), ssVec.load(&nextLine[(int)x+0]), seVec.load(&nextLine[(int)x+1]);
-	Vec16s dxVec =
-	  -(nwVec>>3) + (neVec>>3)
-	  -(wwVec>>2) + (eeVec>>2)
-	  -(swVec>>3) + (seVec>>3);
-	dxVec.store(&dxLine[x]);
-	Vec16s dyVec =
-	  -(nwVec>>3) - (nnVec>>2) - (neVec>>3)
-	  +(swVec>>3) + (ssVec>>2) + (seVec>>3);
-	dyVec.store(&dyLine[x]);
-      }
-# elif INSTRSET >= 2 // SSE2 - 128bits
-      for (size_t x = 0; x < gray.getWidth(); x += 8) {
-	Vec8us nwVec, nnVec, neVec;
-	nwVec.load(&prevLine[(int)x-1]), nnVec.load(&prevLine[(int)x+0]), neVec.load(&prevLine[(int)x+1]);
-	Vec8us wwVec, eeVec;
-	wwVec.load(&currLine[(int)x-1]), eeVec.load(&currLine[(int)x+1]);
-	Vec8us swVec, ssVec, seVec;
-	swVec.load(&nextLine[(int)x-1]), ssVec.load(&nextLine[(int)x+0]), seVec.load(&nextLine[(int)x+1]);
-	Vec8s dxVec =
-	  -(nwVec>>3) + (neVec>>3)
-	  -(wwVec>>2) + (eeVec>>2)
-	  -(swVec>>3) + (seVec>>3);
-	dxVec.store(&dxLine[x]);
-	Vec8s dyVec =
-	  -(nwVec>>3) - (nnVec>>2) - (neVec>>3)
-	  +(swVec>>3) + (ssVec>>2) + (seVec>>3);
-	dyVec.store(&dyLine[x]);
-      }
-# endif
-#elif defined(__ARM_NEON__)
-      for (size_t x = 0; x < gray.getWidth(); x += 8) {
-	uint16x8_t nwVec, nnVec, neVec;
-	nwVec = vld1q_u16((const uint16_t *)&prevLine[(int)x-1]);
-	nnVec = vld1q_u16((const uint16_t *)&prevLine[(int)x+0]);
-	neVec = vld1q_u16((const uint16_t *)&prevLine[(int)x+1]);
-	uint16x8_t wwVec, eeVec;
-	wwVec = vld1q_u16((const uint16_t *)&currLine[(int)x-1]);
-	eeVec = vld1q_u16((const uint16_t *)&currLine[(int)x+1]);
-	uint16x8_t swVec, ssVec, seVec;
-	swVec = vld1q_u16((const uint16_t *)&nextLine[(int)x-1]);
-	ssVec = vld1q_u16((const uint16_t *)&nextLine[(int)x+0]);
-	seVec = vld1q_u16((const uint16_t *)&nextLine[(int)x+1]);
-	
-	int16x8_t lsumVec, rsumVec;
-	uint16x8_t tempVec;
-	tempVec = vdupq_n_u16((uint16_t)0);
-	tempVec = vsra_n_u16(tempVec, nwVec, 3);
-	tempVec = vsra_n_u16(tempVec, wwVec, 2);
-	tempVec = vsra_n_u16(tempVec, swVec, 3);
-	lsumVec = vreinterpretq_s16_u16(tempVec);
-	
-	tempVec = vdupq_n_u16((uint16_t)0);
-	tempVec = vsra_n_u16(tempVec, neVec, 3);
-	tempVec = vsra_n_u16(tempVec, eeVec, 2);
-	tempVec = vsra_n_u16(tempVec, seVec, 3);
-	rsumVec = vreinterpretq_s16_u16(tempVec);
-	
-	int16x8_t dxVec = vsubq_s16(rsum, lsum);
-	vst1q_s16((int16_t *)&dxLine[x], dxVec);
-
-	int16x8_t tsumVec, bsumVec;
-	tempVec = vdupq_n_u16((uint16_t)0);
-	tempVec = vsra_n_u16(tempVec, nwVec, 3);
-	tempVec = vsra_n_u16(tempVec, nnVec, 2);
-	tempVec = vsra_n_u16(tempVec, neVec, 3);
-	tsumVec = vreinterpretq_s16_u16(tempVec);
-	
-	tempVec = vdupq_n_u16((uint16_t)0);
-	tempVec = vsra_n_u16(tempVec, swVec, 3);
-	tempVec = vsra_n_u16(tempVec, ssVec, 2);
-	tempVec = vsra_n_u16(tempVec, seVec, 3);
-	bsumVec = vreinterpretq_s16_u16(tempVec);
-	
-	int16x8_t dyVec = vsubq_s16(bsum, tsum);
-	vst1q_s16((int16_t *)&dyLine[x], dyVec);
+/*
+  The rounded L2 norm of dx/dy, tagged by the magnitude type. The sums of
+  squares of 8-bit input fit the mantissa of a float, so FMA or not they
+  come out the same; those of 16-bit input reach 1.4e11 and go through
+  double, as in edgeSobelMagnitudeLine(), overloaded above per instruction
+  set.
+*/
+template <typename V>
+static inline V sobelNormL2(const V& dx, const V& dy, uint16_t)
+{
+  return round_to_int(sqrt(to_float(dx)*to_float(dx) + to_float(dy)*to_float(dy)));
+}
+
+/*
+  Fused magnitude and orientation, see edgeSobelMagnitudeLine() in
+  sobel.hpp: dx/dy live only in registers, in 32-bit lanes so that the L2
+  norm and the orientation thresholds never overflow.
+*/
+template <typename W, int NORM, int BINS, typename T, typename M>
+inline void sobelMagnitudeLine(const T *prevLine, const T *currLine, const T *nextLine,
+			       M *magLine, uint8_t *dirLine, size_t width)
+{
+  typedef typename W::vec V;
+
+  for (size_t x = 0; x < width; x += W::lanes) {
+    int n = (int)std::min(width - x, (size_t)W::lanes);
+    stencil3x3_window<W, T> window(prevLine, currLine, nextLine, x, n);
+    V dxVec = stencilSum<sobel_dx_stencil::exact>(window);
+    V dyVec = stencilSum<sobel_dy_stencil::exact>(window);
+    V adxVec = abs(dxVec), adyVec = abs(dyVec);
+
+    if (NORM == SOBEL_L2_NORM) {
+      store_narrow(sobelNormL2(dxVec, dyVec, M()), &magLine[x], n);
+    } else {
+      store_narrow(V(adxVec + adyVec), &magLine[x], n);
+    }
+
+    if (BINS) {
+      // same decisions as sobelOrientation()
+      V dirVec = select(V(dxVec ^ dyVec) < V(0), V(3), V(1));
+      dirVec = select((adxVec << 7) < adyVec * V(53), V(2), dirVec);
+      dirVec = select((adyVec << 7) <= adxVec * V(53), V(0), dirVec);
+      if (BINS == 8) {
+	V sideVec = (dyVec << 7) + dxVec * V(53);
+	dirVec += select((sideVec < V(0)) | ((sideVec == V(0)) & (dxVec < V(0))), V(4), V(0));
       }
-#endif
-      gray3x3.shiftFrame(gray, z);
+      store_narrow(dirVec, &dirLine[x], n);
     }
   }
 }
+
+template <typename W, typename T, typename M>
+inline void sobelMagnitudeLine(const T *prevLine, const T *currLine, const T *nextLine,
+			       M *magLine, uint8_t *dirLine, size_t width, int norm, int bins)
+{
+  if (!dirLine) bins = 0;
+  if (norm == SOBEL_L2_NORM) {
+    if (bins == 8) sobelMagnitudeLine<W, SOBEL_L2_NORM, 8>(prevLine, currLine, nextLine, magLine, dirLine, width);
+    else if (bins) sobelMagnitudeLine<W, SOBEL_L2_NORM, 4>(prevLine, currLine, nextLine, magLine, dirLine, width);
+    else sobelMagnitudeLine<W, SOBEL_L2_NORM, 0>(prevLine, currLine, nextLine, magLine, dirLine, width);
+  } else {
+    if (bins == 8) sobelMagnitudeLine<W, SOBEL_L1_NORM, 8>(prevLine, currLine, nextLine, magLine, dirLine, width);
+    else if (bins) sobelMagnitudeLine<W, SOBEL_L1_NORM, 4>(prevLine, currLine, nextLine, magLine, dirLine, width);
+    else sobelMagnitudeLine<W, SOBEL_L1_NORM, 0>(prevLine, currLine, nextLine, magLine, dirLine, width);
+  }
+}
+
+inline void edgeSobelMagnitudeLine(const uint8_t *prevLine, const uint8_t *currLine, const uint8_t *nextLine,
+				   uint16_t *magLine, uint8_t *dirLine, size_t width, int norm, int bins)
+{
+  sobelMagnitudeLine<sobel_widen8x32>(prevLine, currLine, nextLine, magLine, dirLine, width, norm, bins);
+}
+
+inline void edgeSobelMagnitudeLine(const uint16_t *prevLine, const uint16_t *currLine, const uint16_t *nextLine,
+				   uint32_t *magLine, uint8_t *dirLine, size_t width, int norm, int bins)
+{
+  sobelMagnitudeLine<sobel_widen16>(prevLine, currLine, nextLine, magLine, dirLine, width, norm, bins);
+}
+#endif
+
+#ifdef SOBEL_NAMESPACE
+}
+#endif
@@ -0,0 +1,126 @@
+/*
+  Copyright (C) 2017 Hoyoung Lee
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Throughput of the lossy and the precise Sobel kernels for every
+  instruction set the running CPU supports, on 4K and 8K frames. Build
+  it against the dispatched kernels (see sobel.dispatch.cpp):
+
+  g++ -O3 -I. -msse2 -DUSE_SIMD -DUSE_SIMD_DISPATCH sobel.bench.cpp \
+    sobel.d2.o sobel.d5.o sobel.d8.o sobel.d11.o instrset_detect.o -o sobel.bench
+
+  The precise kernels do not keep 80% of the lossy throughput. They sum
+  in lanes twice as wide, so a vector holds half the pixels, and they
+  store twice the bytes. On the test box uint8 -> int16 runs at about
+  55-70% of uint8 -> int8 on 4K and 8K frames, and uint16 -> int32 at
+  55-75% of uint16 -> int16. SSE2 comes closer, as its lossy kernels are
+  not the separable ones. The frames do not fit in the cache, and per
+  pixel the precise kernels move 1 byte in and 4 out (and 4 more read
+  for ownership) against 1 in and 2 out for the lossy ones, so with both
+  near the memory bandwidth the ratio cannot go much above 60%. On lines
+  that stay in the cache the separable engine takes uint8 -> int16 from
+  about 55% to 70% of uint8 -> int8 on AVX2, and from 45% to 55% on
+  AVX512BW. Neither non-temporal stores nor splitting the pixels into
+  even and odd 16-bit lanes, to drop the widening shuffles, gained more
+  than about 10%, which is within the run-to-run noise, and pmaddubsw
+  would not save any: its byte pairs need the same unpacking shuffles as
+  the widening loads.
+
+  The lossy AVX512BW kernels run at x1.3-1.4 of AVX2 on uint8 4K frames
+  on the test box, and on par with them (x0.9-1.05) on uint8 8K and on
+  uint16 frames, which do not fit in the cache and are bound by memory
+  bandwidth at both levels. On lines that stay in the cache they run at
+  x1.5-1.8 of AVX2.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+
+#include "sobel.hpp"
+
+static const int sobel_bench_levels[] = {
+  SOBEL_INSTRSET_SSE2,
+  SOBEL_INSTRSET_SSE41,
+  SOBEL_INSTRSET_AVX2,
+  SOBEL_INSTRSET_AVX512BW
+};
+
+static const char *sobel_bench_names[] = { "SSE2", "SSE4.1", "AVX2", "AVX512BW" };
+
+template <typename T>
+static void fillNoise(cpixmap<T>& img)
+{
+  srand(1);
+  for (size_t y = 0; y < img.getHeight(); ++y) {
+    T *line = img.getLine(y);
+    for (size_t x = 0; x < img.getWidth(); ++x) line[x] = (T)rand();
+  }
+}
+
+// best of a few runs, in milliseconds per frame
+template <typename T, typename S>
+static double timeSobel(cpixmap<T>& gray, cpixmap<S>& dx, cpixmap<S>& dy, int frames)
+{
+  double best = 1e30;
+  for (int run = 0; run < 3; ++run) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; ++i) edgeSobelKernel(gray, dx, dy);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    best = std::min(best, elapsed.count() / frames);
+  }
+  return best;
+}
+
+/*
+  S is the output of the lossy kernels and W the one of the precise
+  kernels, so both modes are timed on the same frame.
+*/
+template <typename T, typename S, typename W>
+static void benchSobel(const char *title, size_t width, size_t height, int frames)
+{
+  cpixmap<T> gray(width, height);
+  cpixmap<S> dx(width, height), dy(width, height);
+  cpixmap<W> wdx(width, height), wdy(width, height);
+  fillNoise(gray);
+
+  double avx2 = 0;
+  printf("%s %zux%zu\n", title, width, height);
+  for (size_t i = 0; i < sizeof(sobel_bench_levels)/sizeof(sobel_bench_levels[0]); ++i) {
+    if (setSobelInstrset(sobel_bench_levels[i]) != sobel_bench_levels[i]) continue;
+    double ms = timeSobel(gray, dx, dy, frames);
+    double precise = timeSobel(gray, wdx, wdy, frames);
+    if (sobel_bench_levels[i] == SOBEL_INSTRSET_AVX2) avx2 = ms;
+    printf("  %-8s lossy %8.3f ms %8.1f Mpixel/s  precise %8.3f ms %8.1f Mpixel/s (%3.0f%%)",
+	   sobel_bench_names[i], ms, width*height / ms / 1e3,
+	   precise, width*height / precise / 1e3, 100 * ms / precise);
+    if (avx2 > 0 && sobel_bench_levels[i] != SOBEL_INSTRSET_AVX2) printf("  x%.2f over AVX2", avx2 / ms);
+    printf("\n");
+  }
+  setSobelInstrset(SOBEL_INSTRSET_AUTO);
+}
+
+int main(int argc, char *argv[])
+{
+  int frames = argc > 1 ? atoi(argv[1]) : 10;
+
+  benchSobel<uint8_t, int8_t, int16_t>("uint8 4K", 3840, 2160, frames);
+  benchSobel<uint8_t, int8_t, int16_t>("uint8 8K", 7680, 4320, frames);
+  benchSobel<uint16_t, int16_t, int32_t>("uint16 4K", 3840, 2160, frames);
+  benchSobel<uint16_t, int16_t, int32_t>("uint16 8K", 7680, 4320, frames);
+  return 0;
+}
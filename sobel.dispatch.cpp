@@ -0,0 +1,469 @@
+/*
+  Copyright (C) 2017 Hoyoung Lee
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Runtime CPU dispatch of the SIMD Sobel kernels, after
+  vectorclass/dispatch_example.cpp. Compile this file once for each
+  instruction set and link all of them together with instrset_detect.cpp:
+
+  g++ -O3 -I. -msse2       -c sobel.dispatch.cpp -o sobel.d2.o
+  g++ -O3 -I. -msse4.1     -c sobel.dispatch.cpp -o sobel.d5.o
+  g++ -O3 -I. -mavx2 -mfma -c sobel.dispatch.cpp -o sobel.d8.o
+  g++ -O3 -I. -mavx512bw   -c sobel.dispatch.cpp -o sobel.d11.o
+  g++ -O3 -I. -msse2       -c vectorclass/instrset_detect.cpp
+  g++ -O3 -I. -msse2 -DUSE_SIMD -DUSE_SIMD_DISPATCH main.cpp \
+    sobel.d2.o sobel.d5.o sobel.d8.o sobel.d11.o instrset_detect.o
+
+  -mfma lets the floating-point kernels use FMA, which every AVX2 CPU has.
+  The SSE2 object also holds the dispatcher and the image kernels, so that
+  window3x3_frame and cpixmap are only ever compiled for the baseline.
+*/
+
+#if defined(__AVX512BW__)
+# define SOBEL_NAMESPACE sobel_avx512bw
+# define SOBEL_LINE_KERNELS sobelLineKernels_AVX512BW
+# define SOBEL_LINE_INSTRSET SOBEL_INSTRSET_AVX512BW
+#elif defined(__AVX2__)
+# define SOBEL_NAMESPACE sobel_avx2
+# define SOBEL_LINE_KERNELS sobelLineKernels_AVX2
+# define SOBEL_LINE_INSTRSET SOBEL_INSTRSET_AVX2
+#elif defined(__SSE4_1__)
+# define SOBEL_NAMESPACE sobel_sse41
+# define SOBEL_LINE_KERNELS sobelLineKernels_SSE41
+# define SOBEL_LINE_INSTRSET SOBEL_INSTRSET_SSE41
+#else
+# define SOBEL_NAMESPACE sobel_sse2
+# define SOBEL_LINE_KERNELS sobelLineKernels_SSE2
+# define SOBEL_LINE_INSTRSET SOBEL_INSTRSET_SSE2
+#endif
+
+// the vector classes of the higher instruction sets must not collide
+// with the baseline ones at link time
+#if defined(__SSE4_1__)
+# define VCL_NAMESPACE SOBEL_NAMESPACE
+#endif
+
+#include "sobel.dispatch.hpp"
+#include "sobel.SIMD.hpp"
+#include "canny.SIMD.hpp"
+
+#define SOBEL_STENCIL_LINES(K) {		\
+    SOBEL_NAMESPACE::stencil3x3Line<K>,		\
+    SOBEL_NAMESPACE::stencil3x3Line<K>,		\
+    SOBEL_NAMESPACE::stencil3x3Line<K>,		\
+    SOBEL_NAMESPACE::stencil3x3Line<K>,		\
+    SOBEL_NAMESPACE::stencil3x3Line<K>,		\
+    SOBEL_NAMESPACE::stencil3x3Line<K>,		\
+    SOBEL_NAMESPACE::stencil3x3BlockLine<K>,	\
+    SOBEL_NAMESPACE::stencil3x3BlockLine<K>,	\
+    SOBEL_NAMESPACE::stencil3x3BlockLine<K>,	\
+    SOBEL_NAMESPACE::stencil3x3BlockLine<K>,	\
+    SOBEL_NAMESPACE::stencil3x3BlockLine<K>,	\
+    SOBEL_NAMESPACE::stencil3x3BlockLine<K> }
+#define SOBEL_STENCIL_PAIR_LINES(KX, KY) {		\
+    SOBEL_NAMESPACE::stencil3x3PairLine<KX, KY>,	\
+    SOBEL_NAMESPACE::stencil3x3PairLine<KX, KY>,	\
+    SOBEL_NAMESPACE::stencil3x3PairLine<KX, KY>,	\
+    SOBEL_NAMESPACE::stencil3x3PairLine<KX, KY>,	\
+    SOBEL_NAMESPACE::stencil3x3PairLine<KX, KY>,	\
+    SOBEL_NAMESPACE::stencil3x3PairLine<KX, KY>,	\
+    SOBEL_NAMESPACE::stencil3x3PairBlockLine<KX, KY>,	\
+    SOBEL_NAMESPACE::stencil3x3PairBlockLine<KX, KY>,	\
+    SOBEL_NAMESPACE::stencil3x3PairBlockLine<KX, KY>,	\
+    SOBEL_NAMESPACE::stencil3x3PairBlockLine<KX, KY>,	\
+    SOBEL_NAMESPACE::stencil3x3PairBlockLine<KX, KY>,	\
+    SOBEL_NAMESPACE::stencil3x3PairBlockLine<KX, KY> }
+
+#define SOBEL_SEPARABLE_LINES(K) {		\
+    SOBEL_NAMESPACE::stencilSeparableLine<K>,	\
+    SOBEL_NAMESPACE::stencilSeparableLine<K> }
+#define SOBEL_SEPARABLE_PAIR_LINES(KX, KY) {		\
+    SOBEL_NAMESPACE::stencilSeparablePairLine<KX, KY>,	\
+    SOBEL_NAMESPACE::stencilSeparablePairLine<KX, KY> }
+
+extern const sobel_line_kernels SOBEL_LINE_KERNELS = {
+  SOBEL_LINE_INSTRSET,
+  SOBEL_STENCIL_LINES(sobel_dx_stencil),
+  SOBEL_STENCIL_LINES(sobel_dy_stencil),
+  SOBEL_STENCIL_PAIR_LINES(sobel_dx_stencil, sobel_dy_stencil),
+  SOBEL_STENCIL_LINES(scharr_dx_stencil),
+  SOBEL_STENCIL_LINES(scharr_dy_stencil),
+  SOBEL_STENCIL_PAIR_LINES(scharr_dx_stencil, scharr_dy_stencil),
+  SOBEL_STENCIL_LINES(prewitt_dx_stencil),
+  SOBEL_STENCIL_LINES(prewitt_dy_stencil),
+  SOBEL_STENCIL_PAIR_LINES(prewitt_dx_stencil, prewitt_dy_stencil),
+  SOBEL_STENCIL_LINES(laplacian_stencil),
+  SOBEL_SEPARABLE_LINES(sobel5x5_dx_stencil),
+  SOBEL_SEPARABLE_LINES(sobel5x5_dy_stencil),
+  SOBEL_SEPARABLE_PAIR_LINES(sobel5x5_dx_stencil, sobel5x5_dy_stencil),
+  SOBEL_SEPARABLE_LINES(sobel7x7_dx_stencil),
+  SOBEL_SEPARABLE_LINES(sobel7x7_dy_stencil),
+  SOBEL_SEPARABLE_PAIR_LINES(sobel7x7_dx_stencil, sobel7x7_dy_stencil),
+  SOBEL_NAMESPACE::edgeSobelMagnitudeLine,
+  SOBEL_NAMESPACE::edgeSobelMagnitudeLine,
+  SOBEL_NAMESPACE::cannyNmsLine16,
+  SOBEL_NAMESPACE::cannyNmsLine32
+};
+
+#if !defined(__SSE4_1__)
+// make dispatcher in only the lowest of the compiled versions
+
+#include <cstdio>
+
+#if !defined(USE_SIMD)
+# define USE_SIMD
+#endif
+#if !defined(USE_SIMD_DISPATCH)
+# define USE_SIMD_DISPATCH
+#endif
+#include "sobel.hpp"
+#include "canny.hpp"
+
+extern const sobel_line_kernels sobelLineKernels_SSE41;
+extern const sobel_line_kernels sobelLineKernels_AVX2;
+extern const sobel_line_kernels sobelLineKernels_AVX512BW;
+
+static const sobel_line_kernels *sobel_line_kernels_pointer = NULL;
+
+int setSobelInstrset(int iset)
+{
+  int detected = instrset_detect();
+
+  if (iset == SOBEL_INSTRSET_AUTO) iset = detected;
+  if (iset > detected) return -1;
+
+  if      (iset >= SOBEL_INSTRSET_AVX512BW) sobel_line_kernels_pointer = &sobelLineKernels_AVX512BW;
+  else if (iset >= SOBEL_INSTRSET_AVX2) sobel_line_kernels_pointer = &sobelLineKernels_AVX2;
+  else if (iset >= SOBEL_INSTRSET_SSE41) sobel_line_kernels_pointer = &sobelLineKernels_SSE41;
+  else if (iset >= SOBEL_INSTRSET_SSE2) sobel_line_kernels_pointer = &sobelLineKernels_SSE2;
+  else {
+    fprintf(stderr, "\nError: Instruction set SSE2 not supported on this computer");
+    return -1;
+  }
+  return sobel_line_kernels_pointer->instrset;
+}
+
+int getSobelInstrset(void)
+{
+  if (!sobel_line_kernels_pointer) setSobelInstrset(SOBEL_INSTRSET_AUTO);
+  return sobel_line_kernels_pointer ? sobel_line_kernels_pointer->instrset : -1;
+}
+
+static inline const sobel_line_kernels& getSobelLineKernels(void)
+{
+  if (!sobel_line_kernels_pointer) setSobelInstrset(SOBEL_INSTRSET_AUTO);
+  assert(sobel_line_kernels_pointer);
+  return *sobel_line_kernels_pointer;
+}
+
+// the line kernels of a stencil filter for the pixel types T/S
+template <typename T, typename S>
+struct sobel_stencil_select {};
+
+template <>
+struct sobel_stencil_select<uint8_t, int8_t> {
+  static decltype(sobel_stencil_lines::line8) get(const sobel_stencil_lines& l) { return l.line8; }
+  static decltype(sobel_stencil_pair_lines::line8) get(const sobel_stencil_pair_lines& l) { return l.line8; }
+  static decltype(sobel_stencil_lines::block8) getBlock(const sobel_stencil_lines& l) { return l.block8; }
+  static decltype(sobel_stencil_pair_lines::block8) getBlock(const sobel_stencil_pair_lines& l) { return l.block8; }
+};
+
+template <>
+struct sobel_stencil_select<uint16_t, int16_t> {
+  static decltype(sobel_stencil_lines::line16) get(const sobel_stencil_lines& l) { return l.line16; }
+  static decltype(sobel_stencil_pair_lines::line16) get(const sobel_stencil_pair_lines& l) { return l.line16; }
+  static decltype(sobel_stencil_lines::block16) getBlock(const sobel_stencil_lines& l) { return l.block16; }
+  static decltype(sobel_stencil_pair_lines::block16) getBlock(const sobel_stencil_pair_lines& l) { return l.block16; }
+};
+
+template <>
+struct sobel_stencil_select<uint8_t, int16_t> {
+  static decltype(sobel_stencil_lines::line8to16) get(const sobel_stencil_lines& l) { return l.line8to16; }
+  static decltype(sobel_stencil_pair_lines::line8to16) get(const sobel_stencil_pair_lines& l) { return l.line8to16; }
+  static decltype(sobel_stencil_lines::block8to16) getBlock(const sobel_stencil_lines& l) { return l.block8to16; }
+  static decltype(sobel_stencil_pair_lines::block8to16) getBlock(const sobel_stencil_pair_lines& l) { return l.block8to16; }
+};
+
+template <>
+struct sobel_stencil_select<uint16_t, int32_t> {
+  static decltype(sobel_stencil_lines::line16to32) get(const sobel_stencil_lines& l) { return l.line16to32; }
+  static decltype(sobel_stencil_pair_lines::line16to32) get(const sobel_stencil_pair_lines& l) { return l.line16to32; }
+  static decltype(sobel_stencil_lines::block16to32) getBlock(const sobel_stencil_lines& l) { return l.block16to32; }
+  static decltype(sobel_stencil_pair_lines::block16to32) getBlock(const sobel_stencil_pair_lines& l) { return l.block16to32; }
+};
+
+template <>
+struct sobel_stencil_select<float, float> {
+  static decltype(sobel_stencil_lines::line32f) get(const sobel_stencil_lines& l) { return l.line32f; }
+  static decltype(sobel_stencil_pair_lines::line32f) get(const sobel_stencil_pair_lines& l) { return l.line32f; }
+  static decltype(sobel_stencil_lines::block32f) getBlock(const sobel_stencil_lines& l) { return l.block32f; }
+  static decltype(sobel_stencil_pair_lines::block32f) getBlock(const sobel_stencil_pair_lines& l) { return l.block32f; }
+};
+
+template <>
+struct sobel_stencil_select<double, double> {
+  static decltype(sobel_stencil_lines::line64f) get(const sobel_stencil_lines& l) { return l.line64f; }
+  static decltype(sobel_stencil_pair_lines::line64f) get(const sobel_stencil_pair_lines& l) { return l.line64f; }
+  static decltype(sobel_stencil_lines::block64f) getBlock(const sobel_stencil_lines& l) { return l.block64f; }
+  static decltype(sobel_stencil_pair_lines::block64f) getBlock(const sobel_stencil_pair_lines& l) { return l.block64f; }
+};
+
+template <typename B, typename T, typename S>
+void edgeHSobelKernel(cpixmap<T>& gray, cpixmap<S>& dx, const B& border)
+{
+  const sobel_stencil_lines& lines = getSobelLineKernels().hsobel;
+  sobel3x3Frame<B>(gray, dx, sobel_stencil_select<T, S>::get(lines), sobel_stencil_select<T, S>::getBlock(lines),
+		   border);
+}
+
+template <typename B, typename T, typename S>
+void edgeVSobelKernel(cpixmap<T>& gray, cpixmap<S>& dy, const B& border)
+{
+  const sobel_stencil_lines& lines = getSobelLineKernels().vsobel;
+  sobel3x3Frame<B>(gray, dy, sobel_stencil_select<T, S>::get(lines), sobel_stencil_select<T, S>::getBlock(lines),
+		   border);
+}
+
+template <typename B, typename T, typename S>
+void edgeSobelKernel(cpixmap<T>& gray, cpixmap<S>& dx, cpixmap<S>& dy, const B& border)
+{
+  const sobel_stencil_pair_lines& lines = getSobelLineKernels().sobel;
+  sobel3x3Frame<B>(gray, dx, dy, sobel_stencil_select<T, S>::get(lines), sobel_stencil_select<T, S>::getBlock(lines),
+		   border);
+}
+
+template <typename B, typename T, typename S>
+void edgeSobelKernel(const cpixmap_view<T>& gray, cpixmap<S>& dx, cpixmap<S>& dy, const B& border)
+{
+  const sobel_stencil_pair_lines& lines = getSobelLineKernels().sobel;
+  sobel3x3Frame<B>(gray, dx, dy, sobel_stencil_select<T, S>::get(lines), sobel_stencil_select<T, S>::getBlock(lines),
+		   border);
+}
+
+template <typename B, typename T, typename S>
+void edgeSobelKernel(const cpixmap_view<T>& gray, const cpixmap_view<S>& dx, const cpixmap_view<S>& dy, const B& border)
+{
+  const sobel_stencil_pair_lines& lines = getSobelLineKernels().sobel;
+  sobel3x3Frame<B>(gray, dx, dy, sobel_stencil_select<T, S>::get(lines), sobel_stencil_select<T, S>::getBlock(lines),
+		   border);
+}
+
+template <typename B, typename T, typename S>
+void edgeHScharrKernel(cpixmap<T>& gray, cpixmap<S>& dx, const B& border)
+{
+  const sobel_stencil_lines& lines = getSobelLineKernels().hscharr;
+  sobel3x3Frame<B>(gray, dx, sobel_stencil_select<T, S>::get(lines), sobel_stencil_select<T, S>::getBlock(lines),
+		   border);
+}
+
+template <typename B, typename T, typename S>
+void edgeVScharrKernel(cpixmap<T>& gray, cpixmap<S>& dy, const B& border)
+{
+  const sobel_stencil_lines& lines = getSobelLineKernels().vscharr;
+  sobel3x3Frame<B>(gray, dy, sobel_stencil_select<T, S>::get(lines), sobel_stencil_select<T, S>::getBlock(lines),
+		   border);
+}
+
+template <typename B, typename T, typename S>
+void edgeScharrKernel(cpixmap<T>& gray, cpixmap<S>& dx, cpixmap<S>& dy, const B& border)
+{
+  const sobel_stencil_pair_lines& lines = getSobelLineKernels().scharr;
+  sobel3x3Frame<B>(gray, dx, dy, sobel_stencil_select<T, S>::get(lines), sobel_stencil_select<T, S>::getBlock(lines),
+		   border);
+}
+
+template <typename B, typename T, typename S>
+void edgeHPrewittKernel(cpixmap<T>& gray, cpixmap<S>& dx, const B& border)
+{
+  const sobel_stencil_lines& lines = getSobelLineKernels().hprewitt;
+  sobel3x3Frame<B>(gray, dx, sobel_stencil_select<T, S>::get(lines), sobel_stencil_select<T, S>::getBlock(lines),
+		   border);
+}
+
+template <typename B, typename T, typename S>
+void edgeVPrewittKernel(cpixmap<T>& gray, cpixmap<S>& dy, const B& border)
+{
+  const sobel_stencil_lines& lines = getSobelLineKernels().vprewitt;
+  sobel3x3Frame<B>(gray, dy, sobel_stencil_select<T, S>::get(lines), sobel_stencil_select<T, S>::getBlock(lines),
+		   border);
+}
+
+template <typename B, typename T, typename S>
+void edgePrewittKernel(cpixmap<T>& gray, cpixmap<S>& dx, cpixmap<S>& dy, const B& border)
+{
+  const sobel_stencil_pair_lines& lines = getSobelLineKernels().prewitt;
+  sobel3x3Frame<B>(gray, dx, dy, sobel_stencil_select<T, S>::get(lines), sobel_stencil_select<T, S>::getBlock(lines),
+		   border);
+}
+
+template <typename B, typename T, typename S>
+void edgeLaplacianKernel(cpixmap<T>& gray, cpixmap<S>& d2, const B& border)
+{
+  const sobel_stencil_lines& lines = getSobelLineKernels().laplacian;
+  sobel3x3Frame<B>(gray, d2, sobel_stencil_select<T, S>::get(lines), sobel_stencil_select<T, S>::getBlock(lines),
+		   border);
+}
+
+#define SOBEL_STENCIL_KERNELS(B, T, S)					\
+  template void edgeHSobelKernel<B>(cpixmap<T>&, cpixmap<S>&, const B&);		\
+  template void edgeVSobelKernel<B>(cpixmap<T>&, cpixmap<S>&, const B&);		\
+  template void edgeSobelKernel<B>(cpixmap<T>&, cpixmap<S>&, cpixmap<S>&, const B&);	\
+  template void edgeSobelKernel<B>(const cpixmap_view<T>&, cpixmap<S>&, cpixmap<S>&, const B&); \
+  template void edgeSobelKernel<B>(const cpixmap_view<T>&, const cpixmap_view<S>&, const cpixmap_view<S>&, const B&); \
+  template void edgeHScharrKernel<B>(cpixmap<T>&, cpixmap<S>&, const B&);		\
+  template void edgeVScharrKernel<B>(cpixmap<T>&, cpixmap<S>&, const B&);		\
+  template void edgeScharrKernel<B>(cpixmap<T>&, cpixmap<S>&, cpixmap<S>&, const B&);	\
+  template void edgeHPrewittKernel<B>(cpixmap<T>&, cpixmap<S>&, const B&);		\
+  template void edgeVPrewittKernel<B>(cpixmap<T>&, cpixmap<S>&, const B&);		\
+  template void edgePrewittKernel<B>(cpixmap<T>&, cpixmap<S>&, cpixmap<S>&, const B&);	\
+  template void edgeLaplacianKernel<B>(cpixmap<T>&, cpixmap<S>&, const B&);
+
+// the line kernels of a separable filter for the gray type T
+template <typename T>
+struct sobel_separable_select {};
+
+template <>
+struct sobel_separable_select<uint8_t> {
+  template <int SIZE>
+  static decltype(sobel_separable_lines<SIZE>::line8) get(const sobel_separable_lines<SIZE>& l) { return l.line8; }
+  template <int SIZE>
+  static decltype(sobel_separable_pair_lines<SIZE>::line8) get(const sobel_separable_pair_lines<SIZE>& l) { return l.line8; }
+};
+
+template <>
+struct sobel_separable_select<uint16_t> {
+  template <int SIZE>
+  static decltype(sobel_separable_lines<SIZE>::line16) get(const sobel_separable_lines<SIZE>& l) { return l.line16; }
+  template <int SIZE>
+  static decltype(sobel_separable_pair_lines<SIZE>::line16) get(const sobel_separable_pair_lines<SIZE>& l) { return l.line16; }
+};
+
+template <typename B, typename T>
+void edgeHSobel5x5Kernel(cpixmap<T>& gray, cpixmap<typename sobel_extended<T, 5>::type>& dx, const B& border)
+{
+  sobelSeparableFrame<2, B>(gray, dx, sobel_separable_select<T>::get(getSobelLineKernels().hsobel5x5), border);
+}
+
+template <typename B, typename T>
+void edgeVSobel5x5Kernel(cpixmap<T>& gray, cpixmap<typename sobel_extended<T, 5>::type>& dy, const B& border)
+{
+  sobelSeparableFrame<2, B>(gray, dy, sobel_separable_select<T>::get(getSobelLineKernels().vsobel5x5), border);
+}
+
+template <typename B, typename T>
+void edgeSobel5x5Kernel(cpixmap<T>& gray, cpixmap<typename sobel_extended<T, 5>::type>& dx,
+			cpixmap<typename sobel_extended<T, 5>::type>& dy, const B& border)
+{
+  sobelSeparableFrame<2, B>(gray, dx, dy, sobel_separable_select<T>::get(getSobelLineKernels().sobel5x5), border);
+}
+
+template <typename B, typename T>
+void edgeHSobel7x7Kernel(cpixmap<T>& gray, cpixmap<typename sobel_extended<T, 7>::type>& dx, const B& border)
+{
+  sobelSeparableFrame<3, B>(gray, dx, sobel_separable_select<T>::get(getSobelLineKernels().hsobel7x7), border);
+}
+
+template <typename B, typename T>
+void edgeVSobel7x7Kernel(cpixmap<T>& gray, cpixmap<typename sobel_extended<T, 7>::type>& dy, const B& border)
+{
+  sobelSeparableFrame<3, B>(gray, dy, sobel_separable_select<T>::get(getSobelLineKernels().vsobel7x7), border);
+}
+
+template <typename B, typename T>
+void edgeSobel7x7Kernel(cpixmap<T>& gray, cpixmap<typename sobel_extended<T, 7>::type>& dx,
+			cpixmap<typename sobel_extended<T, 7>::type>& dy, const B& border)
+{
+  sobelSeparableFrame<3, B>(gray, dx, dy, sobel_separable_select<T>::get(getSobelLineKernels().sobel7x7), border);
+}
+
+#define SOBEL_SEPARABLE_KERNELS(B, T)					\
+  template void edgeHSobel5x5Kernel<B>(cpixmap<T>&, cpixmap<sobel_extended<T, 5>::type>&, const B&); \
+  template void edgeVSobel5x5Kernel<B>(cpixmap<T>&, cpixmap<sobel_extended<T, 5>::type>&, const B&); \
+  template void edgeSobel5x5Kernel<B>(cpixmap<T>&, cpixmap<sobel_extended<T, 5>::type>&, \
+				      cpixmap<sobel_extended<T, 5>::type>&, const B&); \
+  template void edgeHSobel7x7Kernel<B>(cpixmap<T>&, cpixmap<sobel_extended<T, 7>::type>&, const B&); \
+  template void edgeVSobel7x7Kernel<B>(cpixmap<T>&, cpixmap<sobel_extended<T, 7>::type>&, const B&); \
+  template void edgeSobel7x7Kernel<B>(cpixmap<T>&, cpixmap<sobel_extended<T, 7>::type>&, \
+				      cpixmap<sobel_extended<T, 7>::type>&, const B&);
+
+template <typename B>
+void edgeSobelMagnitudeKernel(cpixmap<uint8_t>& gray, cpixmap<uint16_t>& mag, int norm, const B& border)
+{
+  sobel3x3Frame<B>(gray, mag, NULL, norm, 0, getSobelLineKernels().mag8, border);
+}
+
+template <typename B>
+void edgeSobelMagnitudeKernel(cpixmap<uint8_t>& gray, cpixmap<uint16_t>& mag,
+			      cpixmap<uint8_t>& dir, int bins, int norm, const B& border)
+{
+  sobel3x3Frame<B>(gray, mag, &dir, norm, bins, getSobelLineKernels().mag8, border);
+}
+
+template <typename B>
+void edgeSobelMagnitudeKernel(cpixmap<uint16_t>& gray, cpixmap<uint32_t>& mag, int norm, const B& border)
+{
+  sobel3x3Frame<B>(gray, mag, NULL, norm, 0, getSobelLineKernels().mag16, border);
+}
+
+template <typename B>
+void edgeSobelMagnitudeKernel(cpixmap<uint16_t>& gray, cpixmap<uint32_t>& mag,
+			      cpixmap<uint8_t>& dir, int bins, int norm, const B& border)
+{
+  sobel3x3Frame<B>(gray, mag, &dir, norm, bins, getSobelLineKernels().mag16, border);
+}
+
+template <typename B>
+void edgeCannyKernel(cpixmap<uint8_t>& gray, cpixmap<uint8_t>& edges,
+		     uint16_t low, uint16_t high, int norm, const B& border)
+{
+  const sobel_line_kernels& kernels = getSobelLineKernels();
+  canny3x3Frame<B>(gray, edges, low, high, norm, kernels.mag8, kernels.nms16, border);
+}
+
+template <typename B>
+void edgeCannyKernel(cpixmap<uint16_t>& gray, cpixmap<uint8_t>& edges,
+		     uint32_t low, uint32_t high, int norm, const B& border)
+{
+  const sobel_line_kernels& kernels = getSobelLineKernels();
+  canny3x3Frame<B>(gray, edges, low, high, norm, kernels.mag16, kernels.nms32, border);
+}
+
+#define SOBEL_BORDER_KERNELS(B)						\
+  SOBEL_STENCIL_KERNELS(B, uint8_t, int8_t)				\
+  SOBEL_STENCIL_KERNELS(B, uint16_t, int16_t)				\
+  SOBEL_STENCIL_KERNELS(B, uint8_t, int16_t)				\
+  SOBEL_STENCIL_KERNELS(B, uint16_t, int32_t)				\
+  SOBEL_STENCIL_KERNELS(B, float, float)				\
+  SOBEL_STENCIL_KERNELS(B, double, double)				\
+  SOBEL_SEPARABLE_KERNELS(B, uint8_t)					\
+  SOBEL_SEPARABLE_KERNELS(B, uint16_t)					\
+  template void edgeSobelMagnitudeKernel<B>(cpixmap<uint8_t>&, cpixmap<uint16_t>&, int, const B&); \
+  template void edgeSobelMagnitudeKernel<B>(cpixmap<uint8_t>&, cpixmap<uint16_t>&, cpixmap<uint8_t>&, int, int, \
+					    const B&); \
+  template void edgeSobelMagnitudeKernel<B>(cpixmap<uint16_t>&, cpixmap<uint32_t>&, int, const B&); \
+  template void edgeSobelMagnitudeKernel<B>(cpixmap<uint16_t>&, cpixmap<uint32_t>&, cpixmap<uint8_t>&, int, int, \
+					    const B&); \
+  template void edgeCannyKernel<B>(cpixmap<uint8_t>&, cpixmap<uint8_t>&, uint16_t, uint16_t, int, const B&); \
+  template void edgeCannyKernel<B>(cpixmap<uint16_t>&, cpixmap<uint8_t>&, uint32_t, uint32_t, int, const B&);
+
+SOBEL_BORDER_KERNELS(border_zero)
+SOBEL_BORDER_KERNELS(border_replicate)
+SOBEL_BORDER_KERNELS(border_reflect)
+SOBEL_BORDER_KERNELS(border_wrap)
+SOBEL_BORDER_KERNELS(border_constant_value)
+
+#endif  // !__SSE4_1__
@@ -0,0 +1,195 @@
+/*
+  Copyright (C) 2017 Hoyoung Lee
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <cstdint>
+
+#include <cpixmap.hpp>
+#include <cchunk.hpp>
+#include <sobel.types.hpp>
+
+/*
+  Runtime CPU dispatch for the SIMD Sobel kernels.
+
+  sobel.dispatch.cpp is compiled once per instruction set, and the version
+  for the best instruction set of the running CPU is picked at the first
+  call (see the build recipe at the top of sobel.dispatch.cpp). Define
+  USE_SIMD and USE_SIMD_DISPATCH before including sobel.hpp to get these
+  declarations instead of the inline kernels of sobel.SIMD.hpp.
+*/
+
+// Values as returned by instrset_detect()
+enum SOBEL_INSTRSET {
+  SOBEL_INSTRSET_AUTO = 0,
+  SOBEL_INSTRSET_SSE2 = 2,
+  SOBEL_INSTRSET_SSE41 = 5,
+  SOBEL_INSTRSET_AVX2 = 8,
+  SOBEL_INSTRSET_AVX512BW = 11
+};
+
+// Line kernels of one stencil filter (see stencil.hpp) for every pixel type
+struct sobel_stencil_lines {
+  void (*line8)(const uint8_t *, const uint8_t *, const uint8_t *, int8_t *, size_t);
+  void (*line16)(const uint16_t *, const uint16_t *, const uint16_t *, int16_t *, size_t);
+  // precise mode
+  void (*line8to16)(const uint8_t *, const uint8_t *, const uint8_t *, int16_t *, size_t);
+  void (*line16to32)(const uint16_t *, const uint16_t *, const uint16_t *, int32_t *, size_t);
+  // floating-point pixels
+  void (*line32f)(const float *, const float *, const float *, float *, size_t);
+  void (*line64f)(const double *, const double *, const double *, double *, size_t);
+  // STENCIL_BLOCK_ROWS lines at a time, see stencil3x3BlockLine
+  void (*block8)(const uint8_t *const *, int8_t *const *, size_t);
+  void (*block16)(const uint16_t *const *, int16_t *const *, size_t);
+  void (*block8to16)(const uint8_t *const *, int16_t *const *, size_t);
+  void (*block16to32)(const uint16_t *const *, int32_t *const *, size_t);
+  void (*block32f)(const float *const *, float *const *, size_t);
+  void (*block64f)(const double *const *, double *const *, size_t);
+};
+
+// the same for a dx/dy pair of filters
+struct sobel_stencil_pair_lines {
+  void (*line8)(const uint8_t *, const uint8_t *, const uint8_t *, int8_t *, int8_t *, size_t);
+  void (*line16)(const uint16_t *, const uint16_t *, const uint16_t *, int16_t *, int16_t *, size_t);
+  void (*line8to16)(const uint8_t *, const uint8_t *, const uint8_t *, int16_t *, int16_t *, size_t);
+  void (*line16to32)(const uint16_t *, const uint16_t *, const uint16_t *, int32_t *, int32_t *, size_t);
+  void (*line32f)(const float *, const float *, const float *, float *, float *, size_t);
+  void (*line64f)(const double *, const double *, const double *, double *, double *, size_t);
+  void (*block8)(const uint8_t *const *, int8_t *const *, int8_t *const *, size_t);
+  void (*block16)(const uint16_t *const *, int16_t *const *, int16_t *const *, size_t);
+  void (*block8to16)(const uint8_t *const *, int16_t *const *, int16_t *const *, size_t);
+  void (*block16to32)(const uint16_t *const *, int32_t *const *, int32_t *const *, size_t);
+  void (*block32f)(const float *const *, float *const *, float *const *, size_t);
+  void (*block64f)(const double *const *, double *const *, double *const *, size_t);
+};
+
+// Line kernels of a separable 5x5 or 7x7 filter (see stencilSeparableLine)
+template <int SIZE>
+struct sobel_separable_lines {
+  void (*line8)(const uint8_t *const *, typename sobel_extended<uint8_t, SIZE>::type *, size_t);
+  void (*line16)(const uint16_t *const *, typename sobel_extended<uint16_t, SIZE>::type *, size_t);
+};
+
+template <int SIZE>
+struct sobel_separable_pair_lines {
+  void (*line8)(const uint8_t *const *, typename sobel_extended<uint8_t, SIZE>::type *,
+		typename sobel_extended<uint8_t, SIZE>::type *, size_t);
+  void (*line16)(const uint16_t *const *, typename sobel_extended<uint16_t, SIZE>::type *,
+		 typename sobel_extended<uint16_t, SIZE>::type *, size_t);
+};
+
+// Line kernels compiled for one instruction set
+struct sobel_line_kernels {
+  int instrset;
+  sobel_stencil_lines hsobel, vsobel;
+  sobel_stencil_pair_lines sobel;
+  sobel_stencil_lines hscharr, vscharr;
+  sobel_stencil_pair_lines scharr;
+  sobel_stencil_lines hprewitt, vprewitt;
+  sobel_stencil_pair_lines prewitt;
+  sobel_stencil_lines laplacian;
+  sobel_separable_lines<5> hsobel5x5, vsobel5x5;
+  sobel_separable_pair_lines<5> sobel5x5;
+  sobel_separable_lines<7> hsobel7x7, vsobel7x7;
+  sobel_separable_pair_lines<7> sobel7x7;
+  // fused magnitude and orientation
+  void (*mag8)(const uint8_t *, const uint8_t *, const uint8_t *, uint16_t *, uint8_t *, size_t, int, int);
+  void (*mag16)(const uint16_t *, const uint16_t *, const uint16_t *, uint32_t *, uint8_t *, size_t, int, int);
+  // Canny non-maximum suppression
+  void (*nms16)(const uint16_t *, const uint16_t *, const uint16_t *, const uint8_t *, uint8_t *, size_t, uint16_t, uint16_t);
+  void (*nms32)(const uint32_t *, const uint32_t *, const uint32_t *, const uint8_t *, uint8_t *, size_t, uint32_t, uint32_t);
+};
+
+/*
+  Forces the kernels of the given SOBEL_INSTRSET level, or of the best
+  compiled level below it, e.g. to benchmark every variant on one machine.
+  SOBEL_INSTRSET_AUTO goes back to the best level of the running CPU.
+  Returns the selected level, or -1 when the CPU does not support iset.
+*/
+int setSobelInstrset(int iset = SOBEL_INSTRSET_AUTO);
+int getSobelInstrset(void);
+
+/*
+  The stencil kernels are instantiated in sobel.dispatch.cpp for the pairs
+  uint8_t/int8_t and uint16_t/int16_t (lossy), uint8_t/int16_t and
+  uint16_t/int32_t (precise), and float/float and double/double, and,
+  like the magnitude and Canny kernels, for the borders border_zero,
+  border_replicate, border_reflect, border_wrap and border_constant_value
+  (see cchunk.hpp). The last one carries its fill value at run time, e.g.
+  edgeSobelKernel(gray, dx, dy, border_constant_value(255)).
+*/
+template <typename B = border_zero, typename T, typename S>
+void edgeHSobelKernel(cpixmap<T>& gray, cpixmap<S>& dx, const B& border = B());
+template <typename B = border_zero, typename T, typename S>
+void edgeVSobelKernel(cpixmap<T>& gray, cpixmap<S>& dy, const B& border = B());
+template <typename B = border_zero, typename T, typename S>
+void edgeSobelKernel(cpixmap<T>& gray, cpixmap<S>& dx, cpixmap<S>& dy, const B& border = B());
+template <typename B = border_zero, typename T, typename S>
+void edgeSobelKernel(const cpixmap_view<T>& gray, cpixmap<S>& dx, cpixmap<S>& dy, const B& border = B());
+template <typename B = border_zero, typename T, typename S>
+void edgeSobelKernel(const cpixmap_view<T>& gray, const cpixmap_view<S>& dx, const cpixmap_view<S>& dy,
+		     const B& border = B());
+template <typename B = border_zero, typename T, typename S>
+void edgeHScharrKernel(cpixmap<T>& gray, cpixmap<S>& dx, const B& border = B());
+template <typename B = border_zero, typename T, typename S>
+void edgeVScharrKernel(cpixmap<T>& gray, cpixmap<S>& dy, const B& border = B());
+template <typename B = border_zero, typename T, typename S>
+void edgeScharrKernel(cpixmap<T>& gray, cpixmap<S>& dx, cpixmap<S>& dy, const B& border = B());
+template <typename B = border_zero, typename T, typename S>
+void edgeHPrewittKernel(cpixmap<T>& gray, cpixmap<S>& dx, const B& border = B());
+template <typename B = border_zero, typename T, typename S>
+void edgeVPrewittKernel(cpixmap<T>& gray, cpixmap<S>& dy, const B& border = B());
+template <typename B = border_zero, typename T, typename S>
+void edgePrewittKernel(cpixmap<T>& gray, cpixmap<S>& dx, cpixmap<S>& dy, const B& border = B());
+template <typename B = border_zero, typename T, typename S>
+void edgeLaplacianKernel(cpixmap<T>& gray, cpixmap<S>& d2, const B& border = B());
+
+// instantiated for uint8_t and uint16_t gray, and the same borders
+template <typename B = border_zero, typename T>
+void edgeHSobel5x5Kernel(cpixmap<T>& gray, cpixmap<typename sobel_extended<T, 5>::type>& dx, const B& border = B());
+template <typename B = border_zero, typename T>
+void edgeVSobel5x5Kernel(cpixmap<T>& gray, cpixmap<typename sobel_extended<T, 5>::type>& dy, const B& border = B());
+template <typename B = border_zero, typename T>
+void edgeSobel5x5Kernel(cpixmap<T>& gray, cpixmap<typename sobel_extended<T, 5>::type>& dx,
+			cpixmap<typename sobel_extended<T, 5>::type>& dy, const B& border = B());
+template <typename B = border_zero, typename T>
+void edgeHSobel7x7Kernel(cpixmap<T>& gray, cpixmap<typename sobel_extended<T, 7>::type>& dx, const B& border = B());
+template <typename B = border_zero, typename T>
+void edgeVSobel7x7Kernel(cpixmap<T>& gray, cpixmap<typename sobel_extended<T, 7>::type>& dy, const B& border = B());
+template <typename B = border_zero, typename T>
+void edgeSobel7x7Kernel(cpixmap<T>& gray, cpixmap<typename sobel_extended<T, 7>::type>& dx,
+			cpixmap<typename sobel_extended<T, 7>::type>& dy, const B& border = B());
+
+template <typename B = border_zero>
+void edgeSobelMagnitudeKernel(cpixmap<uint8_t>& gray, cpixmap<uint16_t>& mag,
+			      int norm = SOBEL_L1_NORM, const B& border = B());
+template <typename B = border_zero>
+void edgeSobelMagnitudeKernel(cpixmap<uint8_t>& gray, cpixmap<uint16_t>& mag,
+			      cpixmap<uint8_t>& dir, int bins = 4, int norm = SOBEL_L1_NORM, const B& border = B());
+template <typename B = border_zero>
+void edgeSobelMagnitudeKernel(cpixmap<uint16_t>& gray, cpixmap<uint32_t>& mag,
+			      int norm = SOBEL_L1_NORM, const B& border = B());
+template <typename B = border_zero>
+void edgeSobelMagnitudeKernel(cpixmap<uint16_t>& gray, cpixmap<uint32_t>& mag,
+			      cpixmap<uint8_t>& dir, int bins = 4, int norm = SOBEL_L1_NORM, const B& border = B());
+
+// see canny.hpp
+template <typename B = border_zero>
+void edgeCannyKernel(cpixmap<uint8_t>& gray, cpixmap<uint8_t>& edges,
+		     uint16_t low, uint16_t high, int norm = SOBEL_L2_NORM, const B& border = B());
+template <typename B = border_zero>
+void edgeCannyKernel(cpixmap<uint16_t>& gray, cpixmap<uint8_t>& edges,
+		     uint32_t low, uint32_t high, int norm = SOBEL_L2_NORM, const B& border = B());
@@ -22,9 +22,12 @@
 #include <cstring>
 //#include <float.h>
 #include <type_traits>
+#include <cmath>
 
 #include <cpixmap.hpp>
 #include <cchunk.hpp>
+#include <sobel.types.hpp>
+#include <stencil.hpp>
 
 /* Shift-operated Kernel alternative to normal kernel
   4 3 4                            1 2 1
@@ -32,91 +35,425 @@
   4 3 4                            1 2 1
 */
 
-#if !defined(USE_SIMD)
+/*
+  Splits band z of gray into horizontal strips, one per thread. Each
+  strip walks its own windows of radius R (see window_split) over blocks
+  of rows rows, drafted at its first row together with the halo rows
+  above and below, and hands each span of columns to
+  blockKernel(window, y, n) for the n rows from y of every block, n being
+  rows but for the last block of the strip, so the line kernels run
+  serially and there is a single fork/join per band. A kernel fills the
+  columns [window.getX(), window.getX() + window.getWidth()). B is the
+  border of the windows (see cchunk.hpp), border_zero unless given
+  first, e.g.
+  sobel3x3Frame<border_replicate>(gray, dx, dy, kernel),
+  and border the policy object, which carries the value of a
+  border_constant_value.
+*/
+template <int R, typename B = border_zero, template <typename> class G, typename T, typename F>
+void sobelBlockStrips(const G<T>& gray, size_t z, size_t rows, F blockKernel, const B& border = B())
+{
+#pragma omp parallel
+  {
+    size_t y0, y1;
+    stripRows(gray.getHeight(), y0, y1);
+    if (y0 < y1) {
+      window_split<T, R, B> window(gray, rows, border);
+      window.draftFrame(gray, z, y0);
+      for (size_t y = y0; y < y1; y += rows) {
+	for (size_t i = 0; i < window.getSpans(); ++i) blockKernel(window.getSpan(i), y, std::min(rows, y1 - y));
+	window.shiftFrame(gray, z);
+      }
+    }
+  }
+}
 
-template <typename T>
-typename std::enable_if<std::is_unsigned<T>::value, void>::type
-edgeHSobelKernel(cpixmap<T>& gray, cpixmap<typename std::make_signed<T>::type>& dx)
+// the same one row at a time, lineKernel(window, y)
+template <int R, typename B = border_zero, template <typename> class G, typename T, typename F>
+void sobelStrips(const G<T>& gray, size_t z, F lineKernel, const B& border = B())
 {
-  assert(gray.isMatched(dx));
-  
-  using signed_T = typename std::make_signed<T>::type;
+  sobelBlockStrips<R, B>(gray, z, 1, [&](window_frame<T, R, B>& window, size_t y, size_t) { lineKernel(window, y); },
+			 border);
+}
+
+/*
+  Walks every band of gray in strips (see sobelStrips) and hands the
+  prev/curr/next lines of each row to a line kernel, which fills one
+  output line. Given a block kernel (see stencil3x3BlockLine), the strips
+  go by blocks of STENCIL_BLOCK_ROWS rows, which it fills at once from
+  the lines -1..STENCIL_BLOCK_ROWS of the window, and the line kernel
+  only takes the rows left at the end of a strip. Either image may be a
+  cpixmap or a cpixmap_view; the window of a view reads its halo from
+  the parent. gray may be interleaved or tiled, its window gathers the
+  lines of every band, but the outputs are linear (see
+  cpixmap::isLinear).
+*/
+template <typename B = border_zero, template <typename> class G, template <typename> class D, typename T, typename S>
+void sobel3x3Frame(const G<T>& gray, const D<S>& d,
+		   void (*kernel)(const T *, const T *, const T *, S *, size_t),
+		   void (*blockKernel)(const T *const *, S *const *, size_t) = NULL,
+		   const B& border = B())
+{
+  assert(gray.isResolutionMatched(d) && d.isLinear());
+  const size_t rows = blockKernel ? STENCIL_BLOCK_ROWS : 1;
 
   for (size_t z = 0; z < gray.getBands(); ++z) {
-    //window3x3_frame<typename std::make_unsigned<T>::type> gray3x3(gray);
-    window3x3_frame<T> gray3x3(gray);
-    gray3x3.draftFrame(gray, z);
-
-    for (size_t y = 0; y < gray.getHeight(); ++y) {
-      signed_T *dxLine = dx.getLine(y, z);
-#pragma omp parallel for
-      for (size_t x = 0; x < gray.getWidth(); ++x) {
-	dxLine[x] =
-	  -(gray3x3(y-1, x-1)>>3) + (gray3x3(y-1, x+1)>>3)
-	  -(gray3x3(  y, x-1)>>2) + (gray3x3(  y, x+1)>>2)
-	  -(gray3x3(y+1, x-1)>>3) + (gray3x3(y+1, x+1)>>3);
-      }
-      gray3x3.shiftFrame(gray, z);
-    }
+    sobelBlockStrips<1, B>(gray, z, rows, [&](window3x3_frame<T, B>& gray3x3, size_t y, size_t n) {
+	const size_t x = gray3x3.getX();
+	if (blockKernel && n == STENCIL_BLOCK_ROWS) {
+	  const T *lines[STENCIL_BLOCK_ROWS + 2];
+	  S *out[STENCIL_BLOCK_ROWS];
+	  gray3x3.getLines(lines);
+	  for (size_t i = 0; i < n; ++i) out[i] = d.getLine(y + i, z) + x;
+	  blockKernel(lines, out, gray3x3.getWidth());
+	  return;
+	}
+	for (int i = 0; i < (int)n; ++i)
+	  kernel(gray3x3.getLine(i - 1), gray3x3.getLine(i), gray3x3.getLine(i + 1),
+		 d.getLine(y + i, z) + x, gray3x3.getWidth());
+      }, border);
   }
 }
 
-template <typename T>
-typename std::enable_if<std::is_unsigned<T>::value, void>::type
-edgeVSobelKernel(cpixmap<T>& gray, cpixmap<typename std::make_signed<T>::type>& dy)
+template <typename B = border_zero, template <typename> class G, template <typename> class D, typename T, typename S>
+void sobel3x3Frame(const G<T>& gray, const D<S>& dx, const D<S>& dy,
+		   void (*kernel)(const T *, const T *, const T *, S *, S *, size_t),
+		   void (*blockKernel)(const T *const *, S *const *, S *const *, size_t) = NULL,
+		   const B& border = B())
 {
-  assert(gray.isMatched(dy));
-  
-  using signed_T = typename std::make_signed<T>::type;
-  
+  assert(gray.isResolutionMatched(dx) && dx.isLinear());
+  assert(gray.isResolutionMatched(dy) && dy.isLinear());
+  const size_t rows = blockKernel ? STENCIL_BLOCK_ROWS : 1;
+
   for (size_t z = 0; z < gray.getBands(); ++z) {
-    window3x3_frame<T> gray3x3(gray);
-    gray3x3.draftFrame(gray, z);
-    for (size_t y = 0; y < gray.getHeight(); ++y) {
-      signed_T *dyLine = dy.getLine(y, z);
-#pragma omp parallel for
-      for (size_t x = 0; x < gray.getWidth(); ++x) {
-	dyLine[x] =
-	  -(gray3x3(y-1, x-1)>>3) - (gray3x3(y-1, x)>>2) - (gray3x3(y-1, x+1)>>3)
-	  +(gray3x3(y+1, x-1)>>3) + (gray3x3(y+1, x)>>2) + (gray3x3(y+1, x+1)>>3);
-      }
-      gray3x3.shiftFrame(gray, z);
-    }
+    sobelBlockStrips<1, B>(gray, z, rows, [&](window3x3_frame<T, B>& gray3x3, size_t y, size_t n) {
+	const size_t x = gray3x3.getX();
+	if (blockKernel && n == STENCIL_BLOCK_ROWS) {
+	  const T *lines[STENCIL_BLOCK_ROWS + 2];
+	  S *xOut[STENCIL_BLOCK_ROWS], *yOut[STENCIL_BLOCK_ROWS];
+	  gray3x3.getLines(lines);
+	  for (size_t i = 0; i < n; ++i) xOut[i] = dx.getLine(y + i, z) + x, yOut[i] = dy.getLine(y + i, z) + x;
+	  blockKernel(lines, xOut, yOut, gray3x3.getWidth());
+	  return;
+	}
+	for (int i = 0; i < (int)n; ++i)
+	  kernel(gray3x3.getLine(i - 1), gray3x3.getLine(i), gray3x3.getLine(i + 1),
+		 dx.getLine(y + i, z) + x, dy.getLine(y + i, z) + x, gray3x3.getWidth());
+      }, border);
   }
 }
 
-template <typename T>
-typename std::enable_if<std::is_unsigned<T>::value, void>::type
-edgeSobelKernel(cpixmap<T>& gray,
-		cpixmap<typename std::make_signed<T>::type>& dx,
-		cpixmap<typename std::make_signed<T>::type>& dy)
+template <typename B = border_zero, template <typename> class G, typename T, typename M>
+void sobel3x3Frame(const G<T>& gray, cpixmap<M>& mag, cpixmap<uint8_t> *dir, int norm, int bins,
+		   void (*kernel)(const T *, const T *, const T *, M *, uint8_t *, size_t, int, int),
+		   const B& border = B())
 {
-  assert(gray.isMatched(dx));
-  assert(gray.isMatched(dy));
+  assert(gray.isResolutionMatched(mag) && mag.isLinear());
+  assert(!dir || (gray.isResolutionMatched(*dir) && dir->isLinear()));
 
-  using signed_T = typename std::make_signed<T>::type;
-  
   for (size_t z = 0; z < gray.getBands(); ++z) {
-    window3x3_frame<T> gray3x3(gray);
-    gray3x3.draftFrame(gray, z);
-    for (size_t y = 0; y < gray.getHeight(); ++y) {
-      signed_T *dxLine = dx.getLine(y, z);
-      signed_T *dyLine = dy.getLine(y, z);
-#pragma omp parallel for
-      for (size_t x = 0; x < gray.getWidth(); ++x) {
-	dxLine[x] =
-	  -(gray3x3(y-1, x-1)>>3) + (gray3x3(y-1, x+1)>>3)
-	  -(gray3x3(  y, x-1)>>2) + (gray3x3(  y, x+1)>>2)
-	  -(gray3x3(y+1, x-1)>>3) + (gray3x3(y+1, x+1)>>3);
-	dyLine[x] =
-	  -(gray3x3(y-1, x-1)>>3) - (gray3x3(y-1, x)>>2) - (gray3x3(y-1, x+1)>>3)
-	  +(gray3x3(y+1, x-1)>>3) + (gray3x3(y+1, x)>>2) + (gray3x3(y+1, x+1)>>3);
-      }
-      gray3x3.shiftFrame(gray, z);
-    }
+    sobelStrips<1, B>(gray, z, [&](window3x3_frame<T, B>& gray3x3, size_t y) {
+	const size_t x = gray3x3.getX();
+	kernel(gray3x3.getPrevLine(), gray3x3.getCurrLine(), gray3x3.getNextLine(),
+	       mag.getLine(y, z) + x, dir ? dir->getLine(y, z) + x : NULL, gray3x3.getWidth(), norm, bins);
+      }, border);
+  }
+}
+
+/*
+  The same for a separable line kernel of radius R (see
+  stencilSeparableLine), which reads the lines -R..R of its window.
+*/
+template <int R, typename B = border_zero, template <typename> class G, template <typename> class D, typename T, typename S>
+void sobelSeparableFrame(const G<T>& gray, const D<S>& d, void (*kernel)(const T *const *, S *, size_t),
+			 const B& border = B())
+{
+  assert(gray.isResolutionMatched(d) && d.isLinear());
+
+  for (size_t z = 0; z < gray.getBands(); ++z) {
+    sobelStrips<R, B>(gray, z, [&](window_frame<T, R, B>& window, size_t y) {
+	const T *lines[2*R + 1];
+	window.getLines(lines);
+	kernel(lines, d.getLine(y, z) + window.getX(), window.getWidth());
+      }, border);
+  }
+}
+
+template <int R, typename B = border_zero, template <typename> class G, template <typename> class D, typename T, typename S>
+void sobelSeparableFrame(const G<T>& gray, const D<S>& dx, const D<S>& dy,
+			 void (*kernel)(const T *const *, S *, S *, size_t), const B& border = B())
+{
+  assert(gray.isResolutionMatched(dx) && dx.isLinear());
+  assert(gray.isResolutionMatched(dy) && dy.isLinear());
+
+  for (size_t z = 0; z < gray.getBands(); ++z) {
+    sobelStrips<R, B>(gray, z, [&](window_frame<T, R, B>& window, size_t y) {
+	const T *lines[2*R + 1];
+	const size_t x = window.getX();
+	window.getLines(lines);
+	kernel(lines, dx.getLine(y, z) + x, dy.getLine(y, z) + x, window.getWidth());
+      }, border);
   }
 }
 
+#if !defined(USE_SIMD)
+
+// lane policy of the stencil engine for plain C++: one pixel at a time
+template <typename T, typename S>
+struct stencil_scalar {
+  typedef int vec;
+  enum { lanes = 1 };
+  static vec zero(void) { return 0; }
+  static vec load(const T *p, int) { return *p; }
+  static void store(const vec& v, S *p, int) { *p = (S)v; }
+};
+
+// float and double pixels keep their type and multiply-add the exact taps
+template <typename F>
+struct stencil_scalar_fp {
+  typedef F vec;
+  enum { lanes = 1 };
+  static vec zero(void) { return 0; }
+  static vec mulAdd(const vec& p, int weight, const vec& sum) { return p * (F)weight + sum; }
+  static vec load(const F *p, int) { return *p; }
+  static void store(const vec& v, F *p, int) { *p = v; }
+};
+
+template <>
+struct stencil_scalar<float, float> : stencil_scalar_fp<float> {};
+template <>
+struct stencil_scalar<double, double> : stencil_scalar_fp<double> {};
+
+/*
+  One output line of the stencil filter K, with the lossy taps for a
+  same-width output (uint8 -> int8) and the exact ones for a widened one
+  (uint8 -> int16), see stencil_taps.
+*/
+template <typename K, typename T, typename S>
+inline void stencil3x3Line(const T *prevLine, const T *currLine, const T *nextLine,
+			   S *outLine, size_t width)
+{
+  stencil3x3Lanes<typename stencil_taps<K, T, S>::type, stencil_scalar<T, S> >
+    (prevLine, currLine, nextLine, outLine, width);
+}
+
+template <typename KX, typename KY, typename T, typename S>
+inline void stencil3x3PairLine(const T *prevLine, const T *currLine, const T *nextLine,
+			       S *xLine, S *yLine, size_t width)
+{
+  stencil3x3PairLanes<typename stencil_taps<KX, T, S>::type, typename stencil_taps<KY, T, S>::type,
+		      stencil_scalar<T, S> >(prevLine, currLine, nextLine, xLine, yLine, width);
+}
+
+// STENCIL_BLOCK_ROWS output lines at a time, see stencil3x3BlockLanes()
+template <typename K, typename T, typename S>
+inline void stencil3x3BlockLine(const T *const *lines, S *const *outLines, size_t width)
+{
+  stencil3x3BlockLanes<typename stencil_taps<K, T, S>::type, stencil_scalar<T, S>, STENCIL_BLOCK_ROWS>
+    (lines, outLines, width);
+}
+
+template <typename KX, typename KY, typename T, typename S>
+inline void stencil3x3PairBlockLine(const T *const *lines, S *const *xLines, S *const *yLines, size_t width)
+{
+  stencil3x3PairBlockLanes<typename stencil_taps<KX, T, S>::type, typename stencil_taps<KY, T, S>::type,
+			   stencil_scalar<T, S>, STENCIL_BLOCK_ROWS>(lines, xLines, yLines, width);
+}
+
+/*
+  One output line of the separable stencil K of radius R, e.g.
+  sobel5x5_dx_stencil, from the lines -R..R of a window_frame<T, R>, with
+  the column sums in sobel_widened<T>.
+*/
+template <typename K, typename T, typename S>
+inline void stencilSeparableLine(const T *const *lines, S *outLine, size_t width)
+{
+  typedef typename sobel_widened<T>::type I;
+  stencilSeparableLanes<K, stencil_scalar<T, I>, stencil_scalar<I, S>, I>(lines, outLine, width);
+}
+
+template <typename KX, typename KY, typename T, typename S>
+inline void stencilSeparablePairLine(const T *const *lines, S *xLine, S *yLine, size_t width)
+{
+  typedef typename sobel_widened<T>::type I;
+  stencilSeparablePairLanes<KX, KY, stencil_scalar<T, I>, stencil_scalar<I, S>, I>(lines, xLine, yLine, width);
+}
+
+/*
+  Fused magnitude: the exact dx/dy of each pixel are reduced to their L1
+  or L2 norm, and optionally to a sobelOrientation() code, in the same
+  pass, so dx/dy never go to memory.
+*/
+template <typename T, typename M>
+void edgeSobelMagnitudeLine(const T *prevLine, const T *currLine, const T *nextLine,
+			    M *magLine, uint8_t *dirLine, size_t width, int norm, int bins)
+{
+  // the sums of squares of 16-bit input do not fit a float mantissa
+  typedef typename std::conditional<sizeof(M) <= 2, float, double>::type F;
+
+  for (size_t x = 0; x < width; ++x) {
+    stencil3x3_window<stencil_scalar<T, M>, T> window(prevLine, currLine, nextLine, x, 1);
+    int dx = stencilSum<sobel_dx_stencil::exact>(window);
+    int dy = stencilSum<sobel_dy_stencil::exact>(window);
+    if (norm == SOBEL_L2_NORM)
+      magLine[x] = (M)std::lrint(std::sqrt((F)dx*(F)dx + (F)dy*(F)dy));
+    else
+      magLine[x] = (M)(std::abs(dx) + std::abs(dy));
+    if (dirLine && bins) dirLine[x] = (uint8_t)sobelOrientation(dx, dy, bins);
+  }
+}
+
+#elif defined(USE_SIMD_DISPATCH)
+# include "sobel.dispatch.hpp"
 #else
 # include "sobel.SIMD.hpp"
 #endif
+
+#if !defined(USE_SIMD_DISPATCH)
+/*
+  Image kernels of the stencil filters in stencil.hpp. S picks the mode:
+  the signed type of T's width for the lossy taps, sobel_widened<T> for
+  the exact ones. float and double images (S = T) always get the exact
+  taps. B is the border policy (see cchunk.hpp), e.g.
+  edgeSobelKernel<border_replicate>(gray, dx, dy), or
+  edgeSobelKernel(gray, dx, dy, border_constant_value(255)).
+*/
+template <typename B = border_zero, typename T, typename S>
+void edgeHSobelKernel(cpixmap<T>& gray, cpixmap<S>& dx, const B& border = B())
+{
+  sobel3x3Frame<B>(gray, dx, stencil3x3Line<sobel_dx_stencil, T, S>, stencil3x3BlockLine<sobel_dx_stencil, T, S>, border);
+}
+
+template <typename B = border_zero, typename T, typename S>
+void edgeVSobelKernel(cpixmap<T>& gray, cpixmap<S>& dy, const B& border = B())
+{
+  sobel3x3Frame<B>(gray, dy, stencil3x3Line<sobel_dy_stencil, T, S>, stencil3x3BlockLine<sobel_dy_stencil, T, S>, border);
+}
+
+template <typename B = border_zero, typename T, typename S>
+void edgeSobelKernel(cpixmap<T>& gray, cpixmap<S>& dx, cpixmap<S>& dy, const B& border = B())
+{
+  sobel3x3Frame<B>(gray, dx, dy, stencil3x3PairLine<sobel_dx_stencil, sobel_dy_stencil, T, S>,
+		   stencil3x3PairBlockLine<sobel_dx_stencil, sobel_dy_stencil, T, S>, border);
+}
+
+// Sobel of a region of interest, into a frame of its size or into a view
+template <typename B = border_zero, typename T, typename S>
+void edgeSobelKernel(const cpixmap_view<T>& gray, cpixmap<S>& dx, cpixmap<S>& dy, const B& border = B())
+{
+  sobel3x3Frame<B>(gray, dx, dy, stencil3x3PairLine<sobel_dx_stencil, sobel_dy_stencil, T, S>,
+		   stencil3x3PairBlockLine<sobel_dx_stencil, sobel_dy_stencil, T, S>, border);
+}
+
+template <typename B = border_zero, typename T, typename S>
+void edgeSobelKernel(const cpixmap_view<T>& gray, const cpixmap_view<S>& dx, const cpixmap_view<S>& dy,
+		     const B& border = B())
+{
+  sobel3x3Frame<B>(gray, dx, dy, stencil3x3PairLine<sobel_dx_stencil, sobel_dy_stencil, T, S>,
+		   stencil3x3PairBlockLine<sobel_dx_stencil, sobel_dy_stencil, T, S>, border);
+}
+
+template <typename B = border_zero, typename T, typename S>
+void edgeHScharrKernel(cpixmap<T>& gray, cpixmap<S>& dx, const B& border = B())
+{
+  sobel3x3Frame<B>(gray, dx, stencil3x3Line<scharr_dx_stencil, T, S>, stencil3x3BlockLine<scharr_dx_stencil, T, S>, border);
+}
+
+template <typename B = border_zero, typename T, typename S>
+void edgeVScharrKernel(cpixmap<T>& gray, cpixmap<S>& dy, const B& border = B())
+{
+  sobel3x3Frame<B>(gray, dy, stencil3x3Line<scharr_dy_stencil, T, S>, stencil3x3BlockLine<scharr_dy_stencil, T, S>, border);
+}
+
+template <typename B = border_zero, typename T, typename S>
+void edgeScharrKernel(cpixmap<T>& gray, cpixmap<S>& dx, cpixmap<S>& dy, const B& border = B())
+{
+  sobel3x3Frame<B>(gray, dx, dy, stencil3x3PairLine<scharr_dx_stencil, scharr_dy_stencil, T, S>,
+		   stencil3x3PairBlockLine<scharr_dx_stencil, scharr_dy_stencil, T, S>, border);
+}
+
+template <typename B = border_zero, typename T, typename S>
+void edgeHPrewittKernel(cpixmap<T>& gray, cpixmap<S>& dx, const B& border = B())
+{
+  sobel3x3Frame<B>(gray, dx, stencil3x3Line<prewitt_dx_stencil, T, S>, stencil3x3BlockLine<prewitt_dx_stencil, T, S>, border);
+}
+
+template <typename B = border_zero, typename T, typename S>
+void edgeVPrewittKernel(cpixmap<T>& gray, cpixmap<S>& dy, const B& border = B())
+{
+  sobel3x3Frame<B>(gray, dy, stencil3x3Line<prewitt_dy_stencil, T, S>, stencil3x3BlockLine<prewitt_dy_stencil, T, S>, border);
+}
+
+template <typename B = border_zero, typename T, typename S>
+void edgePrewittKernel(cpixmap<T>& gray, cpixmap<S>& dx, cpixmap<S>& dy, const B& border = B())
+{
+  sobel3x3Frame<B>(gray, dx, dy, stencil3x3PairLine<prewitt_dx_stencil, prewitt_dy_stencil, T, S>,
+		   stencil3x3PairBlockLine<prewitt_dx_stencil, prewitt_dy_stencil, T, S>, border);
+}
+
+template <typename B = border_zero, typename T, typename S>
+void edgeLaplacianKernel(cpixmap<T>& gray, cpixmap<S>& d2, const B& border = B())
+{
+  sobel3x3Frame<B>(gray, d2, stencil3x3Line<laplacian_stencil, T, S>, stencil3x3BlockLine<laplacian_stencil, T, S>, border);
+}
+
+/*
+  5x5 and 7x7 Sobel of uint8 and uint16 gray (see sobel5x5_dx_stencil),
+  with the exact taps into sobel_extended<T, 5> or <T, 7>: smoother
+  derivatives of noisy images in one pass, instead of a blur followed by
+  the 3x3 kernel.
+*/
+template <typename B = border_zero, typename T>
+void edgeHSobel5x5Kernel(cpixmap<T>& gray, cpixmap<typename sobel_extended<T, 5>::type>& dx, const B& border = B())
+{
+  sobelSeparableFrame<2, B>(gray, dx, stencilSeparableLine<sobel5x5_dx_stencil, T, typename sobel_extended<T, 5>::type>, border);
+}
+
+template <typename B = border_zero, typename T>
+void edgeVSobel5x5Kernel(cpixmap<T>& gray, cpixmap<typename sobel_extended<T, 5>::type>& dy, const B& border = B())
+{
+  sobelSeparableFrame<2, B>(gray, dy, stencilSeparableLine<sobel5x5_dy_stencil, T, typename sobel_extended<T, 5>::type>, border);
+}
+
+template <typename B = border_zero, typename T>
+void edgeSobel5x5Kernel(cpixmap<T>& gray, cpixmap<typename sobel_extended<T, 5>::type>& dx,
+			cpixmap<typename sobel_extended<T, 5>::type>& dy, const B& border = B())
+{
+  sobelSeparableFrame<2, B>(gray, dx, dy, stencilSeparablePairLine<sobel5x5_dx_stencil, sobel5x5_dy_stencil,
+			    T, typename sobel_extended<T, 5>::type>, border);
+}
+
+template <typename B = border_zero, typename T>
+void edgeHSobel7x7Kernel(cpixmap<T>& gray, cpixmap<typename sobel_extended<T, 7>::type>& dx, const B& border = B())
+{
+  sobelSeparableFrame<3, B>(gray, dx, stencilSeparableLine<sobel7x7_dx_stencil, T, typename sobel_extended<T, 7>::type>, border);
+}
+
+template <typename B = border_zero, typename T>
+void edgeVSobel7x7Kernel(cpixmap<T>& gray, cpixmap<typename sobel_extended<T, 7>::type>& dy, const B& border = B())
+{
+  sobelSeparableFrame<3, B>(gray, dy, stencilSeparableLine<sobel7x7_dy_stencil, T, typename sobel_extended<T, 7>::type>, border);
+}
+
+template <typename B = border_zero, typename T>
+void edgeSobel7x7Kernel(cpixmap<T>& gray, cpixmap<typename sobel_extended<T, 7>::type>& dx,
+			cpixmap<typename sobel_extended<T, 7>::type>& dy, const B& border = B())
+{
+  sobelSeparableFrame<3, B>(gray, dx, dy, stencilSeparablePairLine<sobel7x7_dx_stencil, sobel7x7_dy_stencil,
+			    T, typename sobel_extended<T, 7>::type>, border);
+}
+
+template <typename B = border_zero, typename T>
+void edgeSobelMagnitudeKernel(cpixmap<T>& gray, cpixmap<typename sobel_magnitude<T>::type>& mag,
+			      int norm = SOBEL_L1_NORM, const B& border = B())
+{
+  sobel3x3Frame<B>(gray, mag, NULL, norm, 0, edgeSobelMagnitudeLine, border);
+}
+
+template <typename B = border_zero, typename T>
+void edgeSobelMagnitudeKernel(cpixmap<T>& gray, cpixmap<typename sobel_magnitude<T>::type>& mag,
+			      cpixmap<uint8_t>& dir, int bins = 4, int norm = SOBEL_L1_NORM, const B& border = B())
+{
+  sobel3x3Frame<B>(gray, mag, &dir, norm, bins, edgeSobelMagnitudeLine, border);
+}
+#endif
@@ -0,0 +1,114 @@
+/*
+  Copyright (C) 2017 Hoyoung Lee
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+  Throughput of the fused (stencil3x3PairBlockLanes) and the separable
+  Sobel engines, the latter over blocks of STENCIL_BLOCK_ROWS lines
+  (stencil3x3SeparablePairBlockLanes) and a line at a time
+  (stencil3x3SeparablePairLanes), on 4K and 8K frames, for the instruction
+  set it is built with, e.g.
+
+  g++ -O3 -I. -mavx2 -mfma -DUSE_SIMD sobel.separable.bench.cpp -o sobel.separable.bench
+
+  The pairs that it finds faster on the separable engine are the ones
+  sobel_separable3x3 picks. Only the lane policies it picks have the
+  prevLanes/nextLanes of that engine, so it builds from SSSE3 to
+  AVX512BW, for the pairs below.
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+
+#include "sobel.hpp"
+
+template <typename T>
+static void fillNoise(cpixmap<T>& img)
+{
+  srand(1);
+  for (size_t y = 0; y < img.getHeight(); ++y) {
+    T *line = img.getLine(y);
+    for (size_t x = 0; x < img.getWidth(); ++x) line[x] = (T)rand();
+  }
+}
+
+template <typename T, typename S>
+static void fusedLines(const T *const *lines, S *const *xLines, S *const *yLines, size_t width)
+{
+  stencil3x3PairBlockLanes<typename stencil_taps<sobel_dx_stencil, T, S>::type,
+			   typename stencil_taps<sobel_dy_stencil, T, S>::type,
+			   typename sobel_lanes<T, S>::type, STENCIL_BLOCK_ROWS>(lines, xLines, yLines, width);
+}
+
+template <typename T, typename S>
+static void separableBlockLines(const T *const *lines, S *const *xLines, S *const *yLines, size_t width)
+{
+  stencil3x3SeparablePairBlockLanes<typename stencil_taps<sobel_dx_stencil, T, S>::type,
+				    typename stencil_taps<sobel_dy_stencil, T, S>::type,
+				    typename sobel_lanes<T, S>::type, STENCIL_BLOCK_ROWS>(lines, xLines, yLines, width);
+}
+
+template <typename T, typename S>
+static void separableLines(const T *const *lines, S *const *xLines, S *const *yLines, size_t width)
+{
+  for (int i = 0; i < STENCIL_BLOCK_ROWS; ++i)
+    stencil3x3SeparablePairLanes<typename stencil_taps<sobel_dx_stencil, T, S>::type,
+				 typename stencil_taps<sobel_dy_stencil, T, S>::type,
+				 typename sobel_lanes<T, S>::type>(lines[i], lines[i + 1], lines[i + 2],
+								   xLines[i], yLines[i], width);
+}
+
+// best of a few runs, in milliseconds per frame
+template <typename T, typename S>
+static double timeSobel(cpixmap<T>& gray, cpixmap<S>& dx, cpixmap<S>& dy, int frames,
+			void (*blockKernel)(const T *const *, S *const *, S *const *, size_t))
+{
+  double best = 1e30;
+  for (int run = 0; run < 3; ++run) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < frames; ++i)
+      sobel3x3Frame(gray, dx, dy, stencil3x3PairLine<sobel_dx_stencil, sobel_dy_stencil, T, S>, blockKernel);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    best = std::min(best, elapsed.count() / frames);
+  }
+  return best;
+}
+
+template <typename T, typename S>
+static void benchSobel(const char *title, size_t width, size_t height, int frames)
+{
+  cpixmap<T> gray(width, height);
+  cpixmap<S> dx(width, height), dy(width, height);
+  fillNoise(gray);
+
+  double fused = timeSobel(gray, dx, dy, frames, fusedLines<T, S>);
+  double block = timeSobel(gray, dx, dy, frames, separableBlockLines<T, S>);
+  double separable = timeSobel(gray, dx, dy, frames, separableLines<T, S>);
+  printf("%-24s %zux%zu  fused %8.3f ms  separable block %8.3f ms x%.2f  line %8.3f ms x%.2f\n",
+	 title, width, height, fused, block, fused / block, separable, fused / separable);
+}
+
+int main(int argc, char *argv[])
+{
+  int frames = argc > 1 ? atoi(argv[1]) : 10;
+
+  benchSobel<uint8_t, int8_t>("uint8 -> int8", 3840, 2160, frames);
+  benchSobel<uint8_t, int8_t>("uint8 -> int8", 7680, 4320, frames);
+  benchSobel<uint16_t, int16_t>("uint16 -> int16", 3840, 2160, frames);
+  benchSobel<uint16_t, int16_t>("uint16 -> int16", 7680, 4320, frames);
+  return 0;
+}
@@ -0,0 +1,96 @@
+/*
+  Copyright (C) 2017 Hoyoung Lee
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+
+/*
+  Output type of the precise kernels: the exact Sobel responses of T need
+  twice its width, uint8 -> int16 and uint16 -> int32.
+*/
+template <typename T>
+struct sobel_widened {};
+template <>
+struct sobel_widened<uint8_t> { typedef int16_t type; };
+template <>
+struct sobel_widened<uint16_t> { typedef int32_t type; };
+
+/*
+  Output type of the exact 5x5 and 7x7 Sobel responses of T (see
+  sobel5x5_dx_stencil), +/-48 and +/-640 times the largest pixel: the
+  widened type, but for the 7x7 of uint8, which needs int32.
+*/
+template <typename T, int SIZE>
+struct sobel_extended { typedef typename sobel_widened<T>::type type; };
+template <>
+struct sobel_extended<uint8_t, 7> { typedef int32_t type; };
+
+/*
+  Output type of the gradient magnitude of T, which is never negative and
+  at most twice the largest exact response.
+*/
+template <typename T>
+struct sobel_magnitude {};
+template <>
+struct sobel_magnitude<uint8_t> { typedef uint16_t type; };
+template <>
+struct sobel_magnitude<uint16_t> { typedef uint32_t type; };
+
+enum SOBEL_NORM {
+  SOBEL_L1_NORM = 1, // |dx| + |dy|
+  SOBEL_L2_NORM = 2  // sqrt(dx*dx + dy*dy), rounded
+};
+
+/*
+  Quantized gradient orientation in image coordinates (x right, y down).
+  4 bins fold the direction modulo 180 degrees, for non-maximum
+  suppression: 0 = horizontal gradient, 1 = 45, 2 = vertical, 3 = 135.
+  8 bins keep the sign: bin k covers k*45 +/- 22.5 degrees.
+  tan(22.5) is taken as 53/128, so everything stays in integers, and the
+  SIMD kernels compute exactly the same codes. A gradient on a boundary
+  goes to the bin nearer to the horizontal at 22.5 degrees and to the
+  diagonal at 67.5 degrees, mirrored in every quadrant, so e.g. 157.5
+  degrees goes with 180 as -22.5 goes with 0.
+*/
+inline int sobelOrientation(int dx, int dy, int bins)
+{
+  int adx = std::abs(dx), ady = std::abs(dy);
+  int dir;
+
+  if (ady * 128 <= adx * 53) dir = 0;
+  else if (adx * 128 < ady * 53) dir = 2;
+  else dir = ((dx ^ dy) < 0) ? 3 : 1;
+
+  if (bins == 8) {
+    // the half plane of 157.5..337.5 degrees, which holds 157.5 itself
+    int side = dy * 128 + dx * 53;
+    if (side < 0 || (side == 0 && dx < 0)) dir += 4;
+  }
+  return dir;
+}
+
+/*
+  Pixel codes of the Canny edge map: CANNY_WEAK/CANNY_STRONG after the
+  double thresholding, CANNY_EDGE/CANNY_NONE after the hysteresis.
+*/
+enum CANNY_EDGE {
+  CANNY_NONE = 0,
+  CANNY_WEAK = 1,
+  CANNY_STRONG = 2,
+  CANNY_EDGE = 255
+};
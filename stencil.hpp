@@ -0,0 +1,781 @@
+/*
+  Copyright (C) 2017 Hoyoung Lee
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+
+#include <cstddef>
+#include <algorithm>
+#include <type_traits>
+
+/*
+  Compile-time 3x3 stencil engine.
+
+  A stencil is a stencil3x3 of nine stencil_tap types, so every weight is
+  a template argument and the engine unrolls into straight shift/add code:
+  taps of weight 0 are never loaded, and the other weights become shifts
+  and adds of the loaded vector (see stencil_mul), which works for 8-bit
+  lanes that have no multiply.
+
+  The engine is written against a lane policy L, which knows how to load
+  and store one vector of pixels for a given instruction set:
+
+    typedef ... vec;           // lane type, int for the scalar code
+    enum { lanes = ... };      // pixels per vec
+    static vec zero(void);
+    static vec load(const T *p, int n);
+    static void store(const vec& v, S *p, int n);
+
+  where n <= lanes is the number of valid pixels at p. load() may read a
+  whole vector regardless of n (see SIMD_PADDING_BYTES in cpixmap.hpp),
+  but store() must not write past the n-th pixel. The policies that run
+  the separable engine also need the vectors one pixel to the left and
+  to the right, taken from two neighbouring vectors:
+
+    static vec prevLanes(const vec& prev, const vec& v);  // prev[lanes-1], v[0..lanes-2]
+    static vec nextLanes(const vec& v, const vec& next);  // v[1..lanes-1], next[0]
+
+  Policies of floating-point pixels add one more function, and the taps
+  become multiply-adds of their weights, which map to FMA where there is
+  one, instead of shifts and adds:
+
+    static vec mulAdd(const vec& p, int weight, const vec& sum);  // p*weight + sum
+
+  The policies live next to the kernels, in sobel.hpp (scalar) and
+  sobel.SIMD.hpp.
+*/
+
+/*
+  The engines are made of many small template functions, which are only
+  fast once inlined into the loop over the line, where their sums stay in
+  registers. In a translation unit with many instantiations, such as
+  sobel.dispatch.cpp, GCC stops inlining at its unit growth limit and the
+  sums go through memory, so the helpers below are always inlined.
+*/
+#if defined(__GNUC__)
+# define STENCIL_INLINE inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+# define STENCIL_INLINE __forceinline
+#else
+# define STENCIL_INLINE inline
+#endif
+
+/*
+  One tap: the pixel is shifted right by SHIFT bits, then multiplied by
+  WEIGHT. The shift is what keeps the lossy kernels inside the lanes of
+  the input pixels; the exact kernels use SHIFT = 0.
+*/
+template <int WEIGHT, int SHIFT = 0>
+struct stencil_tap {
+  static const int weight = WEIGHT;
+  static const int shift = SHIFT;
+};
+
+template <typename NW, typename NN, typename NE,
+	  typename WW, typename OO, typename EE,
+	  typename SW, typename SS, typename SE>
+struct stencil3x3 {
+  typedef NW nw; typedef NN nn; typedef NE ne;
+  typedef WW ww; typedef OO oo; typedef EE ee;
+  typedef SW sw; typedef SS ss; typedef SE se;
+};
+
+// doubling, a shift for the vector classes but an add for the scalar
+// int, where shifting a negative value left is undefined
+template <typename V>
+STENCIL_INLINE V stencilTwice(const V& p) { return p << 1; }
+
+STENCIL_INLINE int stencilTwice(int p) { return p + p; }
+
+// multiplication by a positive constant as shifts and adds
+template <int W>
+struct stencil_mul {
+  template <typename V>
+  static V apply(const V& p)
+  {
+    V q = stencilTwice(stencil_mul<(W >> 1)>::apply(p));
+    return (W & 1) ? V(q + p) : q;
+  }
+};
+
+template <>
+struct stencil_mul<1> {
+  template <typename V>
+  static V apply(const V& p) { return p; }
+};
+
+template <>
+struct stencil_mul<0> {
+  template <typename V>
+  static V apply(const V& p) { return p - p; }
+};
+
+/*
+  The pixels around one vector position of a prev/curr/next line triple,
+  loaded on demand by the taps that need them.
+*/
+template <typename L, typename T>
+class stencil3x3_window {
+public:
+  stencil3x3_window(const T *prevLine, const T *currLine, const T *nextLine, size_t x, int n)
+    : m_x((int)x), m_n(n)
+  {
+    m_line[0] = prevLine, m_line[1] = currLine, m_line[2] = nextLine;
+  }
+  template <int DY, int DX>
+  typename L::vec load(void) const { return L::load(&m_line[DY+1][m_x+DX], m_n); }
+private:
+  const T *m_line[3];
+  int m_x;
+  int m_n;
+};
+
+// true when the lane policy L has a mulAdd(), i.e. floating-point lanes
+template <typename L>
+struct stencil_fused {
+  template <typename U> static char test(decltype(&U::mulAdd));
+  template <typename U> static long test(...);
+  static const bool value = sizeof(test<L>(0)) == sizeof(char);
+};
+
+template <typename TAP, typename L>
+STENCIL_INLINE void stencilWeigh(typename L::vec& sum, typename L::vec p, std::false_type)
+{
+  enum { weight = TAP::weight < 0 ? -TAP::weight : TAP::weight };
+
+  if (TAP::shift) p = p >> TAP::shift;
+  if (TAP::weight > 0) sum = sum + stencil_mul<weight>::apply(p);
+  else sum = sum - stencil_mul<weight>::apply(p);
+}
+
+template <typename TAP, typename L>
+STENCIL_INLINE void stencilWeigh(typename L::vec& sum, const typename L::vec& p, std::true_type)
+{
+  static_assert(TAP::shift == 0, "floating-point lanes take the exact taps");
+  sum = L::mulAdd(p, TAP::weight, sum);
+}
+
+template <typename TAP, int DY, int DX, typename L, typename T>
+STENCIL_INLINE void stencilAccumulate(typename L::vec& sum, const stencil3x3_window<L, T>& window)
+{
+  if (TAP::weight == 0) return;
+  stencilWeigh<TAP, L>(sum, window.template load<DY, DX>(),
+		       std::integral_constant<bool, stencil_fused<L>::value>());
+}
+
+template <typename K, typename L, typename T>
+STENCIL_INLINE typename L::vec stencilSum(const stencil3x3_window<L, T>& window)
+{
+  typename L::vec sum = L::zero();
+  stencilAccumulate<typename K::nw, -1, -1>(sum, window);
+  stencilAccumulate<typename K::nn, -1,  0>(sum, window);
+  stencilAccumulate<typename K::ne, -1,  1>(sum, window);
+  stencilAccumulate<typename K::ww,  0, -1>(sum, window);
+  stencilAccumulate<typename K::oo,  0,  0>(sum, window);
+  stencilAccumulate<typename K::ee,  0,  1>(sum, window);
+  stencilAccumulate<typename K::sw,  1, -1>(sum, window);
+  stencilAccumulate<typename K::ss,  1,  0>(sum, window);
+  stencilAccumulate<typename K::se,  1,  1>(sum, window);
+  return sum;
+}
+
+template <typename K, typename L, typename T, typename S>
+inline void stencil3x3Lanes(const T *prevLine, const T *currLine, const T *nextLine,
+			    S *outLine, size_t width)
+{
+  for (size_t x = 0; x < width; x += L::lanes) {
+    int n = (int)std::min(width - x, (size_t)L::lanes);
+    stencil3x3_window<L, T> window(prevLine, currLine, nextLine, x, n);
+    L::store(stencilSum<K>(window), &outLine[x], n);
+  }
+}
+
+// two stencils over the same window, e.g. dx and dy, sharing the loads
+template <typename KX, typename KY, typename L, typename T, typename S>
+inline void stencil3x3PairLanes(const T *prevLine, const T *currLine, const T *nextLine,
+				S *xLine, S *yLine, size_t width)
+{
+  for (size_t x = 0; x < width; x += L::lanes) {
+    int n = (int)std::min(width - x, (size_t)L::lanes);
+    stencil3x3_window<L, T> window(prevLine, currLine, nextLine, x, n);
+    L::store(stencilSum<KX>(window), &xLine[x], n);
+    L::store(stencilSum<KY>(window), &yLine[x], n);
+  }
+}
+
+/*
+  Separable stencils of any radius: the outer product of a column kernel,
+  the vertical taps, and a row kernel, the horizontal ones, each a
+  stencil_kernel1d of 2R+1 weights from -R to R. The engine runs in
+  blocks of STENCIL_SEPARABLE_BLOCK pixels: the column sums of a block
+  and of the R pixels on either side go to a small buffer, in the lanes
+  of the policy LV (T -> I), and the row sums are taken from that buffer
+  with the policy LH (I -> S), so every pixel is loaded 2R+1 times by the
+  columns instead of (2R+1)^2 times by a direct 2D sum. A kernel whose
+  taps are symmetric, or antisymmetric, about the centre adds, or
+  subtracts, each pair of pixels before weighing it.
+*/
+#ifndef STENCIL_SEPARABLE_BLOCK
+# define STENCIL_SEPARABLE_BLOCK 256
+#endif
+
+template <int I, int... W>
+struct stencil_pick;
+template <int W0, int... W>
+struct stencil_pick<0, W0, W...> { enum { value = W0 }; };
+template <int I, int W0, int... W>
+struct stencil_pick<I, W0, W...> { enum { value = stencil_pick<I-1, W...>::value }; };
+
+template <int... W>
+struct stencil_kernel1d {
+  static_assert(sizeof...(W) & 1, "a kernel has 2R+1 taps");
+  enum { size = sizeof...(W), radius = sizeof...(W) / 2 };
+  template <int I>
+  struct tap : stencil_tap<stencil_pick<I, W...>::value> {};
+};
+
+template <typename COLUMN, typename ROW>
+struct stencil_separable {
+  typedef COLUMN column;
+  typedef ROW row;
+};
+
+template <typename TAP, typename L>
+STENCIL_INLINE void stencilWeighTap(typename L::vec& sum, const typename L::vec& p)
+{
+  if (TAP::weight == 0) return;
+  stencilWeigh<TAP, L>(sum, p, std::integral_constant<bool, stencil_fused<L>::value>());
+}
+
+// sum += the taps I and 2R-I of K, load(i) being the pixel of tap i, and the inner ones
+template <typename K, typename L, int I, typename F>
+STENCIL_INLINE void stencilFold(typename L::vec& sum, const F& load, std::false_type)
+{
+  stencilWeighTap<typename K::template tap<I>, L>(sum, load(I));
+}
+
+template <typename K, typename L, int I, typename F>
+STENCIL_INLINE void stencilFold(typename L::vec& sum, const F& load, std::true_type)
+{
+  enum { J = 2*K::radius - I };
+  typedef typename K::template tap<I> A;
+  typedef typename K::template tap<J> Z;
+
+  if (A::weight == Z::weight)
+    stencilWeighTap<A, L>(sum, load(I) + load(J));
+  else if (A::weight == -Z::weight)
+    stencilWeighTap<Z, L>(sum, load(J) - load(I));
+  else {
+    stencilWeighTap<A, L>(sum, load(I));
+    stencilWeighTap<Z, L>(sum, load(J));
+  }
+  stencilFold<K, L, I+1>(sum, load, std::integral_constant<bool, (I+1 < K::radius)>());
+}
+
+template <typename K, typename L, typename F>
+STENCIL_INLINE typename L::vec stencilFold(const F& load)
+{
+  typename L::vec sum = L::zero();
+  stencilFold<K, L, 0>(sum, load, std::integral_constant<bool, (0 < K::radius)>());
+  return sum;
+}
+
+// the column sums of K at the pixels [x, x + n) of lines -R..R
+template <typename K, typename L, typename T>
+STENCIL_INLINE typename L::vec stencilColumnSum(const T *const *lines, ptrdiff_t x, int n)
+{
+  return stencilFold<K, L>([&](int i) { return L::load(&lines[i][x], n); });
+}
+
+// the row sums of K at the pixels [x, x + n) of the column sums of a block
+template <typename K, typename L, typename I>
+STENCIL_INLINE typename L::vec stencilRowSum(const I *column, size_t x, int n)
+{
+  return stencilFold<K, L>([&](int i) { return L::load(&column[x + i], n); });
+}
+
+template <typename K, typename LV, typename LH, typename I, typename T, typename S>
+inline void stencilSeparableLanes(const T *const *lines, S *outLine, size_t width)
+{
+  typedef typename K::column KV;
+  typedef typename K::row KH;
+  enum { RH = KH::radius };
+  alignas(64) I column[STENCIL_SEPARABLE_BLOCK + 2*RH + 64];
+
+  for (size_t x0 = 0; x0 < width; x0 += STENCIL_SEPARABLE_BLOCK) {
+    const size_t w = std::min(width - x0, (size_t)STENCIL_SEPARABLE_BLOCK), span = w + 2*RH;
+    for (size_t x = 0; x < span; x += LV::lanes) {
+      int n = (int)std::min(span - x, (size_t)LV::lanes);
+      LV::store(stencilColumnSum<KV, LV>(lines, (ptrdiff_t)(x0 + x) - RH, n), &column[x], n);
+    }
+    for (size_t x = 0; x < w; x += LH::lanes) {
+      int n = (int)std::min(w - x, (size_t)LH::lanes);
+      LH::store(stencilRowSum<KH, LH>(column, x, n), &outLine[x0 + x], n);
+    }
+  }
+}
+
+// two separable stencils, e.g. dx and dy, whose column sums share the loads
+template <typename KX, typename KY, typename LV, typename LH, typename I, typename T, typename S>
+inline void stencilSeparablePairLanes(const T *const *lines, S *xLine, S *yLine, size_t width)
+{
+  static_assert((int)KX::column::radius == (int)KY::column::radius, "the pair reads the same lines");
+  enum { RV = KX::column::radius, RH = (int)KX::row::radius > (int)KY::row::radius ? (int)KX::row::radius : (int)KY::row::radius };
+  alignas(64) I xColumn[STENCIL_SEPARABLE_BLOCK + 2*RH + 64];
+  alignas(64) I yColumn[STENCIL_SEPARABLE_BLOCK + 2*RH + 64];
+  typedef typename LV::vec V;
+
+  for (size_t x0 = 0; x0 < width; x0 += STENCIL_SEPARABLE_BLOCK) {
+    const size_t w = std::min(width - x0, (size_t)STENCIL_SEPARABLE_BLOCK), span = w + 2*RH;
+    for (size_t x = 0; x < span; x += LV::lanes) {
+      int n = (int)std::min(span - x, (size_t)LV::lanes);
+      V p[2*RV + 1];
+      for (int i = 0; i <= 2*RV; ++i) p[i] = LV::load(&lines[i][(ptrdiff_t)(x0 + x) - RH], n);
+      LV::store(stencilFold<typename KX::column, LV>([&](int i) { return p[i]; }), &xColumn[x], n);
+      LV::store(stencilFold<typename KY::column, LV>([&](int i) { return p[i]; }), &yColumn[x], n);
+    }
+    for (size_t x = 0; x < w; x += LH::lanes) {
+      int n = (int)std::min(w - x, (size_t)LH::lanes);
+      LH::store(stencilRowSum<typename KX::row, LH>(xColumn + RH - KX::row::radius, x, n), &xLine[x0 + x], n);
+      LH::store(stencilRowSum<typename KY::row, LH>(yColumn + RH - KY::row::radius, x, n), &yLine[x0 + x], n);
+    }
+  }
+}
+
+/*
+  Multi-row blocking of the 3x3 stencils: ROWS output lines at a time,
+  from the ROWS+2 input lines around them. At each vector position the
+  lines are read in order, the pixels at x-1, x and x+1 of each are
+  loaded once, and every output line the input line belongs to takes its
+  row of taps from them: line i is the north row of output i, the centre
+  row of output i-1 and the south row of output i-2. So an input line is
+  loaded once per block instead of once per output line, and only the
+  ROWS sums and the three pixels of the current line stay in registers.
+  STENCIL_BLOCK_ROWS is the ROWS of the image kernels, 1 turns the
+  blocking off. 2 is the fastest on SSE4.1 and AVX2, for this engine and
+  the separable one: at 3 the column sums a dx/dy pair of the separable
+  engine carries over no longer fit in the 16 vector registers, and at 4
+  neither do the sums of this one.
+*/
+#ifndef STENCIL_BLOCK_ROWS
+# define STENCIL_BLOCK_ROWS 2
+#endif
+
+// the taps of row DY of a 3x3 stencil, west to east
+template <typename K, int DY>
+struct stencil3x3_row;
+template <typename K>
+struct stencil3x3_row<K, -1> { typedef typename K::nw w; typedef typename K::nn o; typedef typename K::ne e; };
+template <typename K>
+struct stencil3x3_row<K, 0> { typedef typename K::ww w; typedef typename K::oo o; typedef typename K::ee e; };
+template <typename K>
+struct stencil3x3_row<K, 1> { typedef typename K::sw w; typedef typename K::ss o; typedef typename K::se e; };
+
+// the stencil of no taps, the missing half of a single stencil in the pair engine
+typedef stencil3x3<stencil_tap<0>, stencil_tap<0>, stencil_tap<0>,
+		   stencil_tap<0>, stencil_tap<0>, stencil_tap<0>,
+		   stencil_tap<0>, stencil_tap<0>, stencil_tap<0> > stencil3x3_none;
+
+template <typename K, int DY, int R, typename L>
+STENCIL_INLINE void stencilRowTaps(typename L::vec *, const typename L::vec *, std::false_type) {}
+
+// sum[R] += the taps of row DY of K, p being the pixels at x-1, x and x+1 of the line
+template <typename K, int DY, int R, typename L>
+STENCIL_INLINE void stencilRowTaps(typename L::vec *sum, const typename L::vec *p, std::true_type)
+{
+  typedef stencil3x3_row<K, DY> row;
+  stencilWeighTap<typename row::w, L>(sum[R], p[0]);
+  stencilWeighTap<typename row::o, L>(sum[R], p[1]);
+  stencilWeighTap<typename row::e, L>(sum[R], p[2]);
+}
+
+// the taps of K that read the line I of a block of ROWS output lines
+template <typename K, int ROWS, int I, typename L>
+STENCIL_INLINE void stencilBlockTaps(typename L::vec *sum, const typename L::vec *p)
+{
+  stencilRowTaps<K, -1, I, L>(sum, p, std::integral_constant<bool, (I < ROWS)>());
+  stencilRowTaps<K, 0, I-1, L>(sum, p, std::integral_constant<bool, (I >= 1 && I <= ROWS)>());
+  stencilRowTaps<K, 1, I-2, L>(sum, p, std::integral_constant<bool, (I >= 2)>());
+}
+
+template <typename KX, typename KY, typename L, int ROWS, int I, typename T>
+STENCIL_INLINE void stencilBlockLines(typename L::vec *, typename L::vec *, const T *const *, size_t, int, std::false_type) {}
+
+template <typename KX, typename KY, typename L, int ROWS, int I, typename T>
+STENCIL_INLINE void stencilBlockLines(typename L::vec *xSum, typename L::vec *ySum, const T *const *lines,
+			      size_t x, int n, std::true_type)
+{
+  const T *line = lines[I] + x;
+  const typename L::vec p[3] = { L::load(line - 1, n), L::load(line, n), L::load(line + 1, n) };
+  stencilBlockTaps<KX, ROWS, I, L>(xSum, p);
+  stencilBlockTaps<KY, ROWS, I, L>(ySum, p);
+  stencilBlockLines<KX, KY, L, ROWS, I+1>(xSum, ySum, lines, x, n, std::integral_constant<bool, (I+1 < ROWS+2)>());
+}
+
+// two stencils, e.g. dx and dy, over the lines -1..ROWS of a block into ROWS lines each
+template <typename KX, typename KY, typename L, int ROWS, typename T, typename S>
+inline void stencil3x3PairBlockLanes(const T *const *lines, S *const *xLines, S *const *yLines, size_t width)
+{
+  typedef typename L::vec V;
+
+  for (size_t x = 0; x < width; x += L::lanes) {
+    int n = (int)std::min(width - x, (size_t)L::lanes);
+    V xSum[ROWS], ySum[ROWS];
+    for (int r = 0; r < ROWS; ++r) xSum[r] = ySum[r] = L::zero();
+    stencilBlockLines<KX, KY, L, ROWS, 0>(xSum, ySum, lines, x, n, std::true_type());
+    for (int r = 0; r < ROWS; ++r) {
+      L::store(xSum[r], &xLines[r][x], n);
+      if (!std::is_same<KY, stencil3x3_none>::value) L::store(ySum[r], &yLines[r][x], n);
+    }
+  }
+}
+
+template <typename K, typename L, int ROWS, typename T, typename S>
+inline void stencil3x3BlockLanes(const T *const *lines, S *const *outLines, size_t width)
+{
+  stencil3x3PairBlockLanes<K, stencil3x3_none, L, ROWS>(lines, outLines, (S *const *)NULL, width);
+}
+
+/*
+  Separable engine: every 3x3 stencil is the sum of its three columns, so
+  the west, centre and east column sums are computed once per vector from
+  one aligned load of each line, and the west/east ones are moved by one
+  pixel in registers (prevLanes/nextLanes) instead of being reloaded at
+  x-1 and x+1. An east column equal to the west one, or to its negation,
+  as in dy and dx, is not computed at all. The west and centre part of a
+  vector is summed as soon as the columns of the vector are known, so only
+  that part and the west (and east) column sums are carried over to the
+  next vector, the only lookahead, and the loop runs in order. The first
+  and the last vector of the line have no previous or next one within the
+  loads, and take their west and east columns from unaligned loads at x-1
+  and x+1.
+
+  Like the fused engine it runs over blocks of ROWS output lines, reading
+  each of the lines -1..ROWS of the block once per vector position, so
+  the column sums of all the rows come from the same loads, and carries
+  the parts and the column sums of the ROWS rows over in registers.
+*/
+template <typename A, typename B>
+struct stencil_tap_same
+  : std::integral_constant<bool, A::weight == B::weight && (A::weight == 0 || A::shift == B::shift)> {};
+
+template <typename A, typename B>
+struct stencil_tap_negated
+  : std::integral_constant<bool, A::weight == -B::weight && (A::weight == 0 || A::shift == B::shift)> {};
+
+// 1 when the east column of K is the west one, -1 when it is its negation, 0 otherwise
+template <typename K>
+struct stencil3x3_east {
+  enum {
+    value = (stencil_tap_same<typename K::ne, typename K::nw>::value &&
+	     stencil_tap_same<typename K::ee, typename K::ww>::value &&
+	     stencil_tap_same<typename K::se, typename K::sw>::value) ? 1 :
+    (stencil_tap_negated<typename K::ne, typename K::nw>::value &&
+     stencil_tap_negated<typename K::ee, typename K::ww>::value &&
+     stencil_tap_negated<typename K::se, typename K::sw>::value) ? -1 : 0
+  };
+};
+
+/*
+  The column sums of the ROWS output lines of a block, one array of
+  vectors per column, which the compiler keeps in registers where an
+  array of structs of them would go to the stack.
+*/
+template <typename L, int ROWS>
+struct stencil3x3_columns {
+  typename L::vec ww[ROWS], oo[ROWS], ee[ROWS];
+};
+
+// the columns the block engine sums: the west, the centre and the east taps
+enum {
+  STENCIL_WEST = 1,
+  STENCIL_CENTRE = 2,
+  STENCIL_EAST = 4
+};
+
+template <typename K, int DY, int R, int COLUMNS, typename L, int ROWS>
+STENCIL_INLINE void stencilColumnTaps(stencil3x3_columns<L, ROWS>&, const typename L::vec&, std::false_type) {}
+
+// the columns of output R += the taps of row DY of K, p being the pixels of the line
+template <typename K, int DY, int R, int COLUMNS, typename L, int ROWS>
+STENCIL_INLINE void stencilColumnTaps(stencil3x3_columns<L, ROWS>& c, const typename L::vec& p, std::true_type)
+{
+  typedef stencil3x3_row<K, DY> row;
+  if (COLUMNS & STENCIL_WEST) stencilWeighTap<typename row::w, L>(c.ww[R], p);
+  if (COLUMNS & STENCIL_CENTRE) stencilWeighTap<typename row::o, L>(c.oo[R], p);
+  if (COLUMNS & STENCIL_EAST) stencilWeighTap<typename row::e, L>(c.ee[R], p);
+}
+
+// the column taps of K that read the line I of a block of ROWS output lines
+template <typename K, int I, int COLUMNS, typename L, int ROWS>
+STENCIL_INLINE void stencilBlockColumnTaps(stencil3x3_columns<L, ROWS>& c, const typename L::vec& p)
+{
+  stencilColumnTaps<K, -1, I, COLUMNS>(c, p, std::integral_constant<bool, (I < ROWS)>());
+  stencilColumnTaps<K, 0, I-1, COLUMNS>(c, p, std::integral_constant<bool, (I >= 1 && I <= ROWS)>());
+  stencilColumnTaps<K, 1, I-2, COLUMNS>(c, p, std::integral_constant<bool, (I >= 2)>());
+}
+
+template <typename KX, typename KY, int COLUMNS, int DX, int I, typename L, int ROWS, typename T>
+STENCIL_INLINE void stencilBlockColumns(stencil3x3_columns<L, ROWS>&, stencil3x3_columns<L, ROWS>&, const T *const *,
+				size_t, int, std::false_type) {}
+
+// the columns of KX and KY at x+DX of the ROWS output lines, the lines I..ROWS+1 being loaded once each
+template <typename KX, typename KY, int COLUMNS, int DX, int I, typename L, int ROWS, typename T>
+STENCIL_INLINE void stencilBlockColumns(stencil3x3_columns<L, ROWS>& cx, stencil3x3_columns<L, ROWS>& cy,
+				const T *const *lines, size_t x, int n, std::true_type)
+{
+  const typename L::vec p = L::load(lines[I] + x + DX, n);
+  stencilBlockColumnTaps<KX, I, COLUMNS>(cx, p);
+  stencilBlockColumnTaps<KY, I, COLUMNS>(cy, p);
+  stencilBlockColumns<KX, KY, COLUMNS, DX, I+1>(cx, cy, lines, x, n, std::integral_constant<bool, (I+1 < ROWS+2)>());
+}
+
+template <typename L, int ROWS, int R>
+STENCIL_INLINE void stencilZeroColumns(stencil3x3_columns<L, ROWS>&, stencil3x3_columns<L, ROWS>&, std::false_type) {}
+
+template <typename L, int ROWS, int R>
+STENCIL_INLINE void stencilZeroColumns(stencil3x3_columns<L, ROWS>& cx, stencil3x3_columns<L, ROWS>& cy, std::true_type)
+{
+  cx.ww[R] = cx.oo[R] = cx.ee[R] = cy.ww[R] = cy.oo[R] = cy.ee[R] = L::zero();
+  stencilZeroColumns<L, ROWS, R+1>(cx, cy, std::integral_constant<bool, (R+1 < ROWS)>());
+}
+
+template <typename KX, typename KY, int COLUMNS, int DX, typename L, int ROWS, typename T>
+STENCIL_INLINE void stencilBlockColumns(stencil3x3_columns<L, ROWS>& cx, stencil3x3_columns<L, ROWS>& cy,
+				const T *const *lines, size_t x, int n)
+{
+  stencilZeroColumns<L, ROWS, 0>(cx, cy, std::true_type());
+  stencilBlockColumns<KX, KY, COLUMNS, DX, 0>(cx, cy, lines, x, n, std::true_type());
+}
+
+// the column sum the east taps of K come from, see stencil3x3_east
+template <typename K, typename L, int ROWS>
+STENCIL_INLINE const typename L::vec& stencilEastColumn(const stencil3x3_columns<L, ROWS>& c, int r)
+{
+  return stencil3x3_east<K>::value != 0 ? c.ww[r] : c.ee[r];
+}
+
+template <typename K, typename L>
+STENCIL_INLINE typename L::vec stencilAddEast(const typename L::vec& sum, const typename L::vec& ee)
+{
+  return stencil3x3_east<K>::value < 0 ? typename L::vec(sum - ee) : typename L::vec(sum + ee);
+}
+
+template <typename K, typename L, int ROWS, int R, typename S>
+STENCIL_INLINE void stencilSeparableRows(stencil3x3_columns<L, ROWS>&, const stencil3x3_columns<L, ROWS>&,
+				 typename L::vec *, S *const *, size_t, std::false_type) {}
+
+/*
+  The output vectors at x of the rows R..ROWS-1 of K, given the columns c
+  at x and n at the next vector, then the west and centre parts of the
+  next vector, the columns n becoming c. The rows are unrolled here, and
+  the columns moved one by one, for a loop over the rows or a copy of the
+  whole columns keeps the columns of every row in memory.
+*/
+template <typename K, typename L, int ROWS, int R, typename S>
+STENCIL_INLINE void stencilSeparableRows(stencil3x3_columns<L, ROWS>& c, const stencil3x3_columns<L, ROWS>& n,
+				 typename L::vec *part, S *const *outLines, size_t x, std::true_type)
+{
+  typename L::vec ee = L::nextLanes(stencilEastColumn<K>(c, R), stencilEastColumn<K>(n, R));
+  L::store(stencilAddEast<K, L>(part[R], ee), &outLines[R][x], L::lanes);
+  part[R] = L::prevLanes(c.ww[R], n.ww[R]) + n.oo[R];
+  c.ww[R] = n.ww[R], c.ee[R] = n.ee[R];
+  stencilSeparableRows<K, L, ROWS, R+1>(c, n, part, outLines, x, std::integral_constant<bool, (R+1 < ROWS)>());
+}
+
+template <typename L, int ROWS, int R, typename S>
+STENCIL_INLINE void stencilSeparableLastRows(const stencil3x3_columns<L, ROWS>&, const typename L::vec *,
+				     S *const *, size_t, int, std::false_type) {}
+
+// the last, maybe partial, output vectors at x of the rows R..ROWS-1, the east columns in e
+template <typename L, int ROWS, int R, typename S>
+STENCIL_INLINE void stencilSeparableLastRows(const stencil3x3_columns<L, ROWS>& e, const typename L::vec *part,
+				     S *const *outLines, size_t x, int n, std::true_type)
+{
+  L::store(typename L::vec(part[R] + e.ee[R]), &outLines[R][x], n);
+  stencilSeparableLastRows<L, ROWS, R+1>(e, part, outLines, x, n, std::integral_constant<bool, (R+1 < ROWS)>());
+}
+
+template <typename L, int ROWS, int R>
+STENCIL_INLINE void stencilSeparableParts(const stencil3x3_columns<L, ROWS>&, const stencil3x3_columns<L, ROWS>&,
+				  typename L::vec *, std::false_type) {}
+
+// the west and centre parts of the rows R..ROWS-1 of the first vector, the west columns in w
+template <typename L, int ROWS, int R>
+STENCIL_INLINE void stencilSeparableParts(const stencil3x3_columns<L, ROWS>& w, const stencil3x3_columns<L, ROWS>& c,
+				  typename L::vec *part, std::true_type)
+{
+  part[R] = w.ww[R] + c.oo[R];
+  stencilSeparableParts<L, ROWS, R+1>(w, c, part, std::integral_constant<bool, (R+1 < ROWS)>());
+}
+
+// two stencils, e.g. dx and dy, over the lines -1..ROWS of a block into ROWS lines each
+template <typename KX, typename KY, typename L, int ROWS, typename T, typename S>
+inline void stencil3x3SeparablePairBlockLanes(const T *const *lines, S *const *xLines, S *const *yLines,
+					      size_t width)
+{
+  typedef typename L::vec V;
+  enum {
+    XCOLUMNS = STENCIL_WEST | STENCIL_CENTRE | (stencil3x3_east<KX>::value != 0 ? 0 : STENCIL_EAST),
+    YCOLUMNS = STENCIL_WEST | STENCIL_CENTRE | (stencil3x3_east<KY>::value != 0 ? 0 : STENCIL_EAST),
+    COLUMNS = XCOLUMNS | YCOLUMNS
+  };
+  typedef std::integral_constant<bool, !std::is_same<KY, stencil3x3_none>::value> pair;
+  stencil3x3_columns<L, ROWS> cx, cy, nx, ny;
+  V xPart[ROWS], yPart[ROWS];
+
+  // the west and centre parts of the first vector
+  int n = (int)std::min(width, (size_t)L::lanes);
+  stencilBlockColumns<KX, KY, STENCIL_WEST, -1>(nx, ny, lines, 0, n);
+  stencilBlockColumns<KX, KY, COLUMNS, 0>(cx, cy, lines, 0, n);
+  stencilSeparableParts<L, ROWS, 0>(nx, cx, xPart, std::true_type());
+  stencilSeparableParts<L, ROWS, 0>(ny, cy, yPart, pair());
+
+  size_t x = 0;
+  for (; x + L::lanes < width; x += L::lanes) {
+    stencilBlockColumns<KX, KY, COLUMNS, 0>(nx, ny, lines, x + L::lanes,
+					    (int)std::min(width - x - L::lanes, (size_t)L::lanes));
+    stencilSeparableRows<KX, L, ROWS, 0>(cx, nx, xPart, xLines, x, std::true_type());
+    stencilSeparableRows<KY, L, ROWS, 0>(cy, ny, yPart, yLines, x, pair());
+  }
+
+  // the east taps of the last vector, whatever stencil3x3_east says
+  n = (int)(width - x);
+  stencilBlockColumns<KX, KY, STENCIL_EAST, 1>(nx, ny, lines, x, n);
+  stencilSeparableLastRows<L, ROWS, 0>(nx, xPart, xLines, x, n, std::true_type());
+  stencilSeparableLastRows<L, ROWS, 0>(ny, yPart, yLines, x, n, pair());
+}
+
+template <typename K, typename L, int ROWS, typename T, typename S>
+inline void stencil3x3SeparableBlockLanes(const T *const *lines, S *const *outLines, size_t width)
+{
+  stencil3x3SeparablePairBlockLanes<K, stencil3x3_none, L, ROWS>(lines, outLines, (S *const *)NULL, width);
+}
+
+// one line of the separable engine, see the above
+template <typename K, typename L, typename T, typename S>
+inline void stencil3x3SeparableLanes(const T *prevLine, const T *currLine, const T *nextLine,
+				     S *outLine, size_t width)
+{
+  const T *lines[3] = { prevLine, currLine, nextLine };
+  stencil3x3SeparableBlockLanes<K, L, 1>(lines, &outLine, width);
+}
+
+template <typename KX, typename KY, typename L, typename T, typename S>
+inline void stencil3x3SeparablePairLanes(const T *prevLine, const T *currLine, const T *nextLine,
+					 S *xLine, S *yLine, size_t width)
+{
+  const T *lines[3] = { prevLine, currLine, nextLine };
+  stencil3x3SeparablePairBlockLanes<KX, KY, L, 1>(lines, &xLine, &yLine, width);
+}
+
+/*
+  A filter has a lossy and an exact set of taps. The lossy taps keep the
+  responses within the signed type of the input width (int8 for uint8),
+  the exact ones are used when the output is twice as wide as the input
+  (see sobel_widened), and always for floating-point pixels.
+*/
+template <typename K, typename T, typename S>
+struct stencil_taps {
+  typedef typename std::conditional<(sizeof(S) > sizeof(T) || std::is_floating_point<S>::value),
+				    typename K::exact, typename K::lossy>::type type;
+};
+
+typedef stencil_tap<0> stencil_tap0;
+
+// Sobel, lossy = exact / 8
+struct sobel_dx_stencil {
+  typedef stencil3x3<stencil_tap<-1, 3>, stencil_tap0, stencil_tap<1, 3>,
+		     stencil_tap<-1, 2>, stencil_tap0, stencil_tap<1, 2>,
+		     stencil_tap<-1, 3>, stencil_tap0, stencil_tap<1, 3> > lossy;
+  typedef stencil3x3<stencil_tap<-1>, stencil_tap0, stencil_tap<1>,
+		     stencil_tap<-2>, stencil_tap0, stencil_tap<2>,
+		     stencil_tap<-1>, stencil_tap0, stencil_tap<1> > exact;
+};
+
+struct sobel_dy_stencil {
+  typedef stencil3x3<stencil_tap<-1, 3>, stencil_tap<-1, 2>, stencil_tap<-1, 3>,
+		     stencil_tap0,       stencil_tap0,       stencil_tap0,
+		     stencil_tap<1, 3>,  stencil_tap<1, 2>,  stencil_tap<1, 3> > lossy;
+  typedef stencil3x3<stencil_tap<-1>, stencil_tap<-2>, stencil_tap<-1>,
+		     stencil_tap0,    stencil_tap0,    stencil_tap0,
+		     stencil_tap<1>,  stencil_tap<2>,  stencil_tap<1> > exact;
+};
+
+// Scharr, lossy = exact / 32
+struct scharr_dx_stencil {
+  typedef stencil3x3<stencil_tap<-3, 5>,  stencil_tap0, stencil_tap<3, 5>,
+		     stencil_tap<-10, 5>, stencil_tap0, stencil_tap<10, 5>,
+		     stencil_tap<-3, 5>,  stencil_tap0, stencil_tap<3, 5> > lossy;
+  typedef stencil3x3<stencil_tap<-3>,  stencil_tap0, stencil_tap<3>,
+		     stencil_tap<-10>, stencil_tap0, stencil_tap<10>,
+		     stencil_tap<-3>,  stencil_tap0, stencil_tap<3> > exact;
+};
+
+struct scharr_dy_stencil {
+  typedef stencil3x3<stencil_tap<-3, 5>, stencil_tap<-10, 5>, stencil_tap<-3, 5>,
+		     stencil_tap0,       stencil_tap0,        stencil_tap0,
+		     stencil_tap<3, 5>,  stencil_tap<10, 5>,  stencil_tap<3, 5> > lossy;
+  typedef stencil3x3<stencil_tap<-3>, stencil_tap<-10>, stencil_tap<-3>,
+		     stencil_tap0,    stencil_tap0,     stencil_tap0,
+		     stencil_tap<3>,  stencil_tap<10>,  stencil_tap<3> > exact;
+};
+
+// Prewitt, lossy = exact / 8
+struct prewitt_dx_stencil {
+  typedef stencil3x3<stencil_tap<-1, 3>, stencil_tap0, stencil_tap<1, 3>,
+		     stencil_tap<-1, 3>, stencil_tap0, stencil_tap<1, 3>,
+		     stencil_tap<-1, 3>, stencil_tap0, stencil_tap<1, 3> > lossy;
+  typedef stencil3x3<stencil_tap<-1>, stencil_tap0, stencil_tap<1>,
+		     stencil_tap<-1>, stencil_tap0, stencil_tap<1>,
+		     stencil_tap<-1>, stencil_tap0, stencil_tap<1> > exact;
+};
+
+struct prewitt_dy_stencil {
+  typedef stencil3x3<stencil_tap<-1, 3>, stencil_tap<-1, 3>, stencil_tap<-1, 3>,
+		     stencil_tap0,       stencil_tap0,       stencil_tap0,
+		     stencil_tap<1, 3>,  stencil_tap<1, 3>,  stencil_tap<1, 3> > lossy;
+  typedef stencil3x3<stencil_tap<-1>, stencil_tap<-1>, stencil_tap<-1>,
+		     stencil_tap0,    stencil_tap0,    stencil_tap0,
+		     stencil_tap<1>,  stencil_tap<1>,  stencil_tap<1> > exact;
+};
+
+// 4-neighbour Laplacian, lossy = exact / 8
+struct laplacian_stencil {
+  typedef stencil3x3<stencil_tap0,      stencil_tap<1, 3>,  stencil_tap0,
+		     stencil_tap<1, 3>, stencil_tap<-4, 3>, stencil_tap<1, 3>,
+		     stencil_tap0,      stencil_tap<1, 3>,  stencil_tap0> lossy;
+  typedef stencil3x3<stencil_tap0,   stencil_tap<1>,  stencil_tap0,
+		     stencil_tap<1>, stencil_tap<-4>, stencil_tap<1>,
+		     stencil_tap0,   stencil_tap<1>,  stencil_tap0> exact;
+};
+
+/*
+  Extended Sobel of 5x5 and 7x7 (the kernels of OpenCV's getDerivKernels):
+  the binomial smoothing of 2R+1 taps across the derivative, the central
+  difference smoothed by the binomial of 2R-1 taps, so that the larger
+  supports average out more noise. Exact taps only: the responses reach
+  +/-48 (5x5) and +/-640 (7x7) times the largest pixel, see
+  sobel_extended.
+*/
+typedef stencil_kernel1d<1, 4, 6, 4, 1> stencil_binomial5;
+typedef stencil_kernel1d<-1, -2, 0, 2, 1> stencil_derivative5;
+typedef stencil_kernel1d<1, 6, 15, 20, 15, 6, 1> stencil_binomial7;
+typedef stencil_kernel1d<-1, -4, -5, 0, 5, 4, 1> stencil_derivative7;
+
+typedef stencil_separable<stencil_binomial5, stencil_derivative5> sobel5x5_dx_stencil;
+typedef stencil_separable<stencil_derivative5, stencil_binomial5> sobel5x5_dy_stencil;
+typedef stencil_separable<stencil_binomial7, stencil_derivative7> sobel7x7_dx_stencil;
+typedef stencil_separable<stencil_derivative7, stencil_binomial7> sobel7x7_dy_stencil;